@@ -0,0 +1,303 @@
+#include "piglcd.h"
+#include "ArduinoIcon64x64.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// library 자체 frame pipeline benchmark
+// ./piglcd_bench [frames]
+// 결과는 csv 한 줄에 case 하나. 회귀를 비교할수 있게 dummy/emu 모두 결정적인 입력을 쓴다
+//
+// ns_per_frame      : commit/render/draw 호출에 걸린 host 시간, round 중 최소값
+// draw_ns_per_frame : 그중 framebuffer 함수 시간
+// pulses, pin_writes, bytes : bus counter frame당 평균
+// bus_ns_per_frame  : emu 가상 시계 기준 bus 시간 (dummy = 0)
+//
+// dummy는 timing을 0으로 둬서 busy wait 없이 library 비용만 잰다
+// emu는 datasheet timing 그대로 가상 시계로 돌아서 bus 시간이 나온다
+// emu가 timing 위반이나 panel RAM과 driver model 불일치를 찾으면 실패한다
+
+#define BENCH_ROUNDS 5
+#define BENCH_DEFAULT_FRAMES 1000
+
+typedef enum {
+    BENCH_COMMIT,
+    BENCH_RENDER_DIFF_0,
+    BENCH_RENDER_DIFF_1,
+    BENCH_RENDER_DIFF_10,
+    BENCH_RENDER_DIFF_100,
+    BENCH_RENDER_BROADCAST,
+    BENCH_RENDER_REGION,
+    BENCH_PRINT_STRING,
+    BENCH_OVERLAY_ASSIGN,
+    BENCH_DRAW_BITMAP,
+    BENCH_DRAW_SHAPES,
+    BENCH_CASE_MAX_COUNT,
+} bench_case_t;
+
+static const char *case_name_list[BENCH_CASE_MAX_COUNT] = {
+    "commit",
+    "render_diff_0",
+    "render_diff_1",
+    "render_diff_10",
+    "render_diff_100",
+    "render_broadcast",
+    "render_region",
+    "print_string",
+    "overlay_assign",
+    "draw_bitmap",
+    "draw_shapes",
+};
+
+// render_diff_N에서 frame마다 바꾸는 byte 비율 (%)
+static const int diff_percent_list[BENCH_CASE_MAX_COUNT] = {
+    [BENCH_RENDER_DIFF_0] = 0,
+    [BENCH_RENDER_DIFF_1] = 1,
+    [BENCH_RENDER_DIFF_10] = 10,
+    [BENCH_RENDER_DIFF_100] = 100,
+};
+
+struct bench_result_t {
+    uint64_t frames;
+    uint64_t ns;
+    uint64_t draw_ns;
+    uint64_t bus_ns;
+    struct PG_bus_counters_t counters;
+};
+
+// 돌릴때마다 같은 결과가 나오게 rand() 대신 쓴다
+static uint32_t bench_random(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// frame 하나를 돌리고 잰 시간을 돌려준다. 입력을 바꾸는 시간은 빠진다
+static uint64_t bench_run_frame(struct PG_lcd_t *lcd, bench_case_t bench_case, int frame, struct PG_framebuffer_t *buffer, struct PG_framebuffer_t *icon, uint32_t *random_state, uint64_t *draw_ns)
+{
+    int byte_count = PG_PAGES * lcd->columns;
+    uint64_t begin_ns = PG_timing_now_ns();
+    switch(bench_case) {
+        case BENCH_COMMIT:
+            PG_lcd_commit_buffer(lcd);
+            break;
+
+        case BENCH_RENDER_DIFF_0:
+        case BENCH_RENDER_DIFF_1:
+        case BENCH_RENDER_DIFF_10:
+        case BENCH_RENDER_DIFF_100: {
+            int change_count = byte_count * diff_percent_list[bench_case] / 100;
+            if(change_count == byte_count) {
+                for(int i = 0 ; i < byte_count ; ++i) {
+                    buffer->data[PG_BUFFER_INDEX(i / lcd->columns, i % lcd->columns)] ^= 0xFF;
+                }
+                PG_framebuffer_mark_all_dirty(buffer);
+            } else {
+                for(int i = 0 ; i < change_count ; ++i) {
+                    int index = bench_random(random_state) % byte_count;
+                    int page = index / lcd->columns;
+                    int column = index % lcd->columns;
+                    buffer->data[PG_BUFFER_INDEX(page, column)] ^= 1 << (bench_random(random_state) % 8);
+                    PG_framebuffer_mark_dirty(buffer, column, page * 8, 1, 8);
+                }
+            }
+            begin_ns = PG_timing_now_ns();
+            PG_lcd_render_buffer(lcd, buffer);
+            break;
+        }
+
+        case BENCH_RENDER_BROADCAST: {
+            // 모든 chip의 짝수 column이 같은 값으로 바뀌어 chip broadcast로 보내진다
+            // 홀수 column은 chip마다 달라서 broadcast run이 빈틈을 chip 0 byte로 덮으면 안된다
+            int chip_columns = lcd->columns / lcd->chips;
+            int page = frame % PG_PAGES;
+            uint8_t value = bench_random(random_state);
+            for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+                for(int column = 0 ; column < chip_columns ; ++column) {
+                    uint8_t byte = (column % 2 == 0) ? value : (uint8_t)(chip * 0x55);
+                    buffer->data[PG_BUFFER_INDEX(page, chip * chip_columns + column)] = byte;
+                }
+            }
+            PG_framebuffer_mark_dirty(buffer, 0, page * 8, lcd->columns, 8);
+            begin_ns = PG_timing_now_ns();
+            PG_lcd_render_buffer(lcd, buffer);
+            break;
+        }
+
+        case BENCH_RENDER_REGION: {
+            // page 전체를 chip마다 같은 값으로 바꾸고 chip 경계에 걸친 영역만 보낸다
+            // chip마다 dirty 구간이 달라서 broadcast로 합치면 영역 밖까지 쓰게 된다
+            int chip_columns = lcd->columns / lcd->chips;
+            int page = frame % PG_PAGES;
+            uint8_t value = bench_random(random_state);
+            for(int column = 0 ; column < lcd->columns ; ++column) {
+                buffer->data[PG_BUFFER_INDEX(page, column)] = value;
+            }
+            begin_ns = PG_timing_now_ns();
+            PG_lcd_render_region(lcd, buffer, chip_columns - 4, page * 8, 20, 8);
+            break;
+        }
+
+        case BENCH_PRINT_STRING: {
+            char text[32];
+            snprintf(text, sizeof(text), "frame %08d", frame);
+            PG_framebuffer_erase(buffer);
+            begin_ns = PG_timing_now_ns();
+            PG_framebuffer_cursor_to_xy(buffer, frame % 32, (frame * 3) % 56);
+            PG_framebuffer_print_string(buffer, text);
+            *draw_ns += PG_timing_now_ns() - begin_ns;
+            PG_lcd_render_buffer(lcd, buffer);
+            break;
+        }
+
+        case BENCH_OVERLAY_ASSIGN:
+            // 움직이는 그림. 지난 frame 것은 지우고 다시 그린다
+            PG_framebuffer_erase(buffer);
+            begin_ns = PG_timing_now_ns();
+            PG_framebuffer_overlay_assign(buffer, icon, frame % (lcd->columns - icon->width + 1), frame % 8);
+            *draw_ns += PG_timing_now_ns() - begin_ns;
+            PG_lcd_render_buffer(lcd, buffer);
+            break;
+
+        case BENCH_DRAW_BITMAP: {
+            // icon에 그리는 시간만 잰다. icon은 화면 buffer가 아니라 render하지 않는다
+            PG_framebuffer_draw_bitmap(icon, ArduinoIcon64x64);
+            uint64_t ns = PG_timing_now_ns() - begin_ns;
+            *draw_ns += ns;
+            return ns;
+        }
+
+        case BENCH_DRAW_SHAPES: {
+            // gauge 화면 하나. 테두리, 막대 그래프, 바늘, 눈금 원호
+            static const uint8_t pattern[8] = { 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA };
+            PG_framebuffer_erase(buffer);
+            begin_ns = PG_timing_now_ns();
+            int level = frame % 100;
+            PG_framebuffer_draw_rect(buffer, 0, 0, lcd->columns, PG_ROWS, PG_COLOR_SET);
+            PG_framebuffer_fill_pattern(buffer, 4, 4, lcd->columns / 2 - 8, 10, pattern, PG_ROP_COPY);
+            PG_framebuffer_fill_rect(buffer, 4, 4, (lcd->columns / 2 - 8) * level / 100, 10, PG_COLOR_INVERT);
+            for(int i = 0 ; i < 8 ; ++i) {
+                int height = (frame * (i + 3)) % 40;
+                PG_framebuffer_fill_rect(buffer, 6 + i * 7, PG_ROWS - 4 - height, 5, height, PG_COLOR_SET);
+            }
+            int cx = lcd->columns * 3 / 4;
+            PG_framebuffer_draw_arc(buffer, cx, 40, 28, 0, 180, PG_COLOR_SET);
+            PG_framebuffer_fill_circle(buffer, cx, 40, 3, PG_COLOR_SET);
+            PG_framebuffer_draw_line(buffer, cx, 40, cx + (level - 50) / 2, 40 - 24 + abs(level - 50) / 5, PG_COLOR_SET);
+            *draw_ns += PG_timing_now_ns() - begin_ns;
+            PG_lcd_render_buffer(lcd, buffer);
+            break;
+        }
+
+        default:
+            break;
+    }
+    return PG_timing_now_ns() - begin_ns;
+}
+
+static int bench_run_case(PG_backend_t backend, bench_case_t bench_case, int frames, struct bench_result_t *result)
+{
+    struct PG_lcd_t lcd;
+    PG_lcd_initialize(&lcd, backend);
+    PG_lcd_set_default_pins(&lcd);
+    PG_lcd_set_target_fps(&lcd, 0);
+    if(backend == PG_BACKEND_DUMMY) {
+        memset(&lcd.timing, 0, sizeof(lcd.timing));
+        lcd.timing.t_busy_timeout = 1000000;
+    }
+    if(lcd.setup(&lcd, PG_PINMAP_PHYS)) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+
+    // chip마다 다른 내용으로 시작한다. 같으면 commit/render_diff_100이 broadcast로 반만 보낸다
+    // broadcast는 render_broadcast가 따로 잰다
+    uint32_t seed_state = 7;
+    struct PG_framebuffer_t buffer;
+    struct PG_framebuffer_t icon;
+    PG_framebuffer_initialize(&buffer, lcd.columns);
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        for(int column = 0 ; column < lcd.columns ; ++column) {
+            buffer.data[PG_BUFFER_INDEX(page, column)] = bench_random(&seed_state);
+        }
+    }
+    PG_framebuffer_draw_bitmap(&icon, ArduinoIcon64x64);
+    memcpy(lcd.buffer.data, buffer.data, sizeof(buffer.data));
+    PG_lcd_commit_buffer(&lcd);
+    PG_lcd_render_buffer(&lcd, &buffer);
+
+    uint32_t random_state = 1;
+    memset(result, 0, sizeof(*result));
+    result->ns = UINT64_MAX;
+    for(int round = 0 ; round < BENCH_ROUNDS ; ++round) {
+        struct PG_bus_counters_t begin_counters = lcd.lines->counters;
+        uint64_t begin_bus_ns = lcd.emu_now_ns;
+        uint64_t draw_ns = 0;
+        uint64_t ns = 0;
+        for(int frame = 0 ; frame < frames ; ++frame) {
+            ns += bench_run_frame(&lcd, bench_case, round * frames + frame, &buffer, &icon, &random_state, &draw_ns);
+        }
+        if(ns < result->ns) {
+            result->ns = ns;
+            result->draw_ns = draw_ns;
+        }
+
+        // counter는 결정적이라 마지막 round 것을 쓴다
+        const struct PG_bus_counters_t *end_counters = &lcd.lines->counters;
+        result->counters.bytes = end_counters->bytes - begin_counters.bytes;
+        result->counters.commands = end_counters->commands - begin_counters.commands;
+        result->counters.pulses = end_counters->pulses - begin_counters.pulses;
+        result->counters.pin_writes = end_counters->pin_writes - begin_counters.pin_writes;
+        result->counters.changed_bytes = end_counters->changed_bytes - begin_counters.changed_bytes;
+        result->bus_ns = lcd.emu_now_ns - begin_bus_ns;
+    }
+    result->frames = frames;
+
+    int violation_count = 0;
+    for(int i = 0 ; i < PG_EMU_CHECK_MAX_COUNT ; ++i) {
+        if(lcd.emu_violation_count[i] > 0) {
+            fprintf(stderr, "%s: %s violations = %llu\n", case_name_list[bench_case], PG_emu_check_name(i), (unsigned long long)lcd.emu_violation_count[i]);
+            violation_count++;
+        }
+    }
+    PG_lcd_destroy(&lcd);
+    return (violation_count > 0) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = BENCH_DEFAULT_FRAMES;
+    if(argc >= 2) {
+        frames = atoi(argv[1]);
+    }
+    if(frames <= 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    const PG_backend_t backend_list[] = { PG_BACKEND_DUMMY, PG_BACKEND_EMU };
+
+    printf("backend,case,frames,ns_per_frame,draw_ns_per_frame,pulses_per_frame,pin_writes_per_frame,bytes_per_frame,commands_per_frame,bus_ns_per_frame\n");
+    for(size_t i = 0 ; i < sizeof(backend_list) / sizeof(backend_list[0]) ; ++i) {
+        for(int bench_case = 0 ; bench_case < BENCH_CASE_MAX_COUNT ; ++bench_case) {
+            struct bench_result_t result;
+            if(bench_run_case(backend_list[i], bench_case, frames, &result)) {
+                return 1;
+            }
+            double n = (double)result.frames;
+            printf("%s,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                   PG_backend_name(backend_list[i]),
+                   case_name_list[bench_case],
+                   (unsigned long long)result.frames,
+                   result.ns / n,
+                   result.draw_ns / n,
+                   result.counters.pulses / n,
+                   result.counters.pin_writes / n,
+                   result.counters.bytes / n,
+                   result.counters.commands / n,
+                   result.bus_ns / n);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "piglcd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// BDF font를 PG_font_open이 mmap하는 packed font로 바꾼다
+// ./fontpack in.bdf out.pgf [first-last,...]
+// 범위를 주면 그 codepoint만 넣는다. 예) 0x20-0x7e,0xac00-0xd7a3
+
+#define FONT_PACK_MAX_RANGES 32
+#define FONT_PACK_LINE_SIZE 1024
+
+struct font_pack_glyph_t {
+    struct PG_font_glyph_t entry;
+    uint8_t *bitmap;
+    int bitmap_size;
+    int order;      // BDF 안의 순서, 같은 codepoint면 앞의 것을 쓴다
+};
+
+struct font_pack_range_t {
+    uint32_t first;
+    uint32_t last;
+};
+
+static int font_pack_parse_ranges(const char *text, struct font_pack_range_t *range_list)
+{
+    int count = 0;
+    while(*text != '\0') {
+        if(count >= FONT_PACK_MAX_RANGES) {
+            return -1;
+        }
+        char *end;
+        uint32_t first = strtoul(text, &end, 0);
+        uint32_t last = first;
+        if(*end == '-') {
+            last = strtoul(end + 1, &end, 0);
+        }
+        if(end == text || last < first) {
+            return -1;
+        }
+        range_list[count].first = first;
+        range_list[count].last = last;
+        count++;
+        text = (*end == ',') ? end + 1 : end;
+        if(*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static bool font_pack_in_ranges(uint32_t codepoint, const struct font_pack_range_t *range_list, int range_count)
+{
+    if(range_count == 0) {
+        return true;
+    }
+    for(int i = 0 ; i < range_count ; ++i) {
+        if(codepoint >= range_list[i].first && codepoint <= range_list[i].last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int font_pack_compare(const void *a, const void *b)
+{
+    const struct font_pack_glyph_t *lhs = a;
+    const struct font_pack_glyph_t *rhs = b;
+    if(lhs->entry.codepoint != rhs->entry.codepoint) {
+        return (lhs->entry.codepoint > rhs->entry.codepoint) ? 1 : -1;
+    }
+    return lhs->order - rhs->order;
+}
+
+static int font_pack_hex(int c)
+{
+    if(c >= '0' && c <= '9') { return c - '0'; }
+    if(c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if(c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s in.bdf out.pgf [first-last,...]\n", argv[0]);
+        return 1;
+    }
+    struct font_pack_range_t range_list[FONT_PACK_MAX_RANGES];
+    int range_count = 0;
+    if(argc >= 4) {
+        range_count = font_pack_parse_ranges(argv[3], range_list);
+        if(range_count < 0) {
+            fprintf(stderr, "bad range : %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    FILE *fp = fopen(argv[1], "r");
+    if(fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    int bbox_height = 0;
+    int bbox_y = 0;
+    int ascent = -1;
+    int descent = -1;
+    long default_char = -1;
+
+    struct font_pack_glyph_t *glyph_list = NULL;
+    int glyph_count = 0;
+    int glyph_capacity = 0;
+
+    // 지금 읽고 있는 glyph
+    long encoding = -1;
+    int advance = 0;
+    int width = 0;
+    int height = 0;
+    int x_offset = 0;
+    int y_offset = 0;
+    uint8_t *bitmap = NULL;
+    int bitmap_row = -1;
+
+    char line[FONT_PACK_LINE_SIZE];
+    int line_number = 0;
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        int w, h, x, y;
+        long value;
+        if(bitmap_row >= 0) {
+            if(strncmp(line, "ENDCHAR", 7) == 0) {
+                bitmap_row = -1;
+                if(encoding < 0 || !font_pack_in_ranges(encoding, range_list, range_count)) {
+                    free(bitmap);
+                    bitmap = NULL;
+                    continue;
+                }
+                if(glyph_count == glyph_capacity) {
+                    glyph_capacity = glyph_capacity ? glyph_capacity * 2 : 256;
+                    glyph_list = realloc(glyph_list, glyph_capacity * sizeof(glyph_list[0]));
+                }
+                struct font_pack_glyph_t *glyph = &glyph_list[glyph_count++];
+                memset(glyph, 0, sizeof(*glyph));
+                glyph->entry.codepoint = encoding;
+                glyph->entry.width = width;
+                glyph->entry.height = height;
+                glyph->entry.advance = advance;
+                glyph->entry.x_offset = x_offset;
+                // BBX y는 baseline 기준 아래쪽, PG_font는 line 위 기준 위쪽
+                glyph->entry.y_offset = ascent - (y_offset + height);
+                glyph->bitmap = bitmap;
+                glyph->bitmap_size = ((height + 7) / 8) * width;
+                glyph->order = glyph_count;
+                bitmap = NULL;
+                continue;
+            }
+            if(bitmap_row >= height) {
+                continue;
+            }
+            // row 하나 = 왼쪽 pixel이 MSB인 hex. column major page로 옮긴다
+            for(int column = 0 ; column < width ; ++column) {
+                int nibble = font_pack_hex(line[column / 4]);
+                if(nibble < 0) {
+                    fprintf(stderr, "%s:%d: bad bitmap row\n", argv[1], line_number);
+                    return 1;
+                }
+                if((nibble >> (3 - column % 4)) & 1) {
+                    bitmap[(bitmap_row / 8) * width + column] |= 1 << (bitmap_row % 8);
+                }
+            }
+            bitmap_row++;
+        } else if(sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &w, &h, &x, &y) == 4) {
+            bbox_height = h;
+            bbox_y = y;
+        } else if(sscanf(line, "FONT_ASCENT %ld", &value) == 1) {
+            ascent = value;
+        } else if(sscanf(line, "FONT_DESCENT %ld", &value) == 1) {
+            descent = value;
+        } else if(sscanf(line, "DEFAULT_CHAR %ld", &value) == 1) {
+            default_char = value;
+        } else if(strncmp(line, "CHARS ", 6) == 0) {
+            // 여기부터 glyph. ascent가 없으면 bounding box로 정한다
+            if(ascent < 0) {
+                ascent = bbox_height + bbox_y;
+            }
+            if(descent < 0) {
+                descent = -bbox_y;
+            }
+        } else if(strncmp(line, "STARTCHAR", 9) == 0) {
+            encoding = -1;
+            advance = 0;
+            width = 0;
+            height = 0;
+            x_offset = 0;
+            y_offset = 0;
+        } else if(sscanf(line, "ENCODING %ld", &value) == 1) {
+            encoding = value;
+        } else if(sscanf(line, "DWIDTH %d", &w) == 1) {
+            advance = w;
+        } else if(sscanf(line, "BBX %d %d %d %d", &w, &h, &x, &y) == 4) {
+            width = w;
+            height = h;
+            x_offset = x;
+            y_offset = y;
+        } else if(strncmp(line, "BITMAP", 6) == 0) {
+            int glyph_top = ascent - (y_offset + height);
+            bool fits = width >= 0 && width <= 255 && height >= 0 && height <= 255 && advance >= 0 && advance <= 255;
+            fits = fits && x_offset >= -128 && x_offset <= 127 && glyph_top >= -128 && glyph_top <= 127;
+            if(!fits) {
+                fprintf(stderr, "%s:%d: glyph %ld is too large\n", argv[1], line_number, encoding);
+                return 1;
+            }
+            bitmap = calloc(((height + 7) / 8) * width + 1, 1);
+            bitmap_row = 0;
+        }
+    }
+    fclose(fp);
+
+    if(glyph_count == 0 || ascent < 0 || ascent + descent <= 0) {
+        fprintf(stderr, "%s: no glyph\n", argv[1]);
+        return 1;
+    }
+
+    // codepoint 순으로. 같은 codepoint는 앞의 것만 남긴다
+    qsort(glyph_list, glyph_count, sizeof(glyph_list[0]), font_pack_compare);
+    int unique_count = 0;
+    uint32_t bitmap_size = 0;
+    for(int i = 0 ; i < glyph_count ; ++i) {
+        if(unique_count > 0 && glyph_list[unique_count - 1].entry.codepoint == glyph_list[i].entry.codepoint) {
+            free(glyph_list[i].bitmap);
+            continue;
+        }
+        glyph_list[i].entry.bitmap_offset = bitmap_size;
+        bitmap_size += glyph_list[i].bitmap_size;
+        glyph_list[unique_count++] = glyph_list[i];
+    }
+
+    struct PG_font_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PG_FONT_MAGIC, sizeof(header.magic));
+    header.version = PG_FONT_VERSION;
+    header.glyph_size = sizeof(struct PG_font_glyph_t);
+    header.height = ascent + descent;
+    header.ascent = ascent;
+    header.glyph_count = unique_count;
+    header.default_codepoint = (default_char >= 0) ? (uint32_t)default_char : PG_FONT_REPLACEMENT;
+    header.bitmap_size = bitmap_size;
+
+    FILE *out = fopen(argv[2], "wb");
+    if(out == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[2]);
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for(int i = 0 ; i < unique_count && ok ; ++i) {
+        ok = fwrite(&glyph_list[i].entry, sizeof(glyph_list[i].entry), 1, out) == 1;
+    }
+    for(int i = 0 ; i < unique_count && ok ; ++i) {
+        int size = glyph_list[i].bitmap_size;
+        ok = (size == 0) || fwrite(glyph_list[i].bitmap, size, 1, out) == 1;
+    }
+    ok = (fclose(out) == 0) && ok;
+    if(!ok) {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return 1;
+    }
+    printf("%s: %d glyphs, height %d, ascent %d, %u bitmap bytes\n", argv[2], unique_count, header.height, header.ascent, bitmap_size);
+
+    for(int i = 0 ; i < unique_count ; ++i) {
+        free(glyph_list[i].bitmap);
+    }
+    free(glyph_list);
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "piglcd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// backend bus 경로 microbenchmark
+// ./piglcd_gpiobench [count] [backend...]   backend = gpio gpiomem dummy emu glfw
+// api_benchmark/는 외부 API로 pin 하나를 토글하는 시간만 잰다
+// 여기서는 piglcd backend op를 직접 불러서 같은 조건으로 비교한다
+//
+// x86에서 gpio는 wiringPi mock, gpiomem은 GPIOMEM_FAKE_PATH 파일을 register 창으로 mmap한다
+// arm에서는 실제 장치를 쓰므로 root가 필요하다
+//
+// emu가 아닌 backend는 timing을 0으로 둬서 delay 없이 코드 경로만 잰다
+// emu는 delay가 가상 시계라 datasheet timing 그대로 둔다
+//
+// op
+// pin_set_val    : backend pin_set_val로 RS 토글
+// pin_set        : shadow를 거친 PG_lcd_pin_set으로 RS 토글
+// pulse          : backend pulse
+// write_data_bit : data pin 단위로 byte 쓰기 (write_bus op가 없을때 경로)
+// write_bus      : PG_lcd_write_bus + PG_lcd_pulse, data byte 하나
+// data_run       : PG_lcd_bus_write_data_run, 64 byte run
+
+#define GPIO_BENCH_ROUNDS 3
+#define GPIO_BENCH_DEFAULT_COUNT 200000
+#define GPIO_BENCH_RUN_LENGTH 64
+
+typedef enum {
+    GPIO_BENCH_PIN_SET_VAL,
+    GPIO_BENCH_PIN_SET,
+    GPIO_BENCH_PULSE,
+    GPIO_BENCH_WRITE_DATA_BIT,
+    GPIO_BENCH_WRITE_BUS,
+    GPIO_BENCH_DATA_RUN,
+    GPIO_BENCH_OP_MAX_COUNT,
+} gpio_bench_op_t;
+
+static const char *op_name_list[GPIO_BENCH_OP_MAX_COUNT] = {
+    "pin_set_val",
+    "pin_set",
+    "pulse",
+    "write_data_bit",
+    "write_bus",
+    "data_run",
+};
+
+struct gpio_bench_result_t {
+    uint64_t ns;
+    uint64_t transitions;
+    uint64_t bytes;
+    uint64_t pulses;
+};
+
+// byte마다 바뀌는 data pin 수가 고르게 섞이게 한다
+static uint8_t gpio_bench_byte(int i)
+{
+    return (uint8_t)(i * 167 + 13);
+}
+
+static void gpio_bench_run_op(struct PG_lcd_t *lcd, gpio_bench_op_t op, int count, struct gpio_bench_result_t *result)
+{
+    static uint8_t run[GPIO_BENCH_RUN_LENGTH];
+    for(int i = 0 ; i < GPIO_BENCH_RUN_LENGTH ; ++i) {
+        run[i] = gpio_bench_byte(i);
+    }
+    struct PG_bus_counters_t begin_counters = lcd->lines->counters;
+    uint64_t begin_ns = PG_timing_now_ns();
+    switch(op) {
+        case GPIO_BENCH_PIN_SET_VAL:
+            for(int i = 0 ; i < count ; ++i) {
+                lcd->pin_set_val(lcd, lcd->pin_rs, i & 1);
+            }
+            break;
+        case GPIO_BENCH_PIN_SET:
+            for(int i = 0 ; i < count ; ++i) {
+                PG_lcd_pin_set(lcd, lcd->pin_rs, i & 1);
+            }
+            break;
+        case GPIO_BENCH_PULSE:
+            for(int i = 0 ; i < count ; ++i) {
+                PG_lcd_pulse(lcd);
+            }
+            break;
+        case GPIO_BENCH_WRITE_DATA_BIT:
+            for(int i = 0 ; i < count ; ++i) {
+                PG_lcd_write_data_bit(lcd, gpio_bench_byte(i));
+            }
+            break;
+        case GPIO_BENCH_WRITE_BUS:
+            for(int i = 0 ; i < count ; ++i) {
+                PG_lcd_write_bus(lcd, 1, gpio_bench_byte(i));
+                PG_lcd_pulse(lcd);
+            }
+            break;
+        case GPIO_BENCH_DATA_RUN:
+            for(int i = 0 ; i < count ; i += GPIO_BENCH_RUN_LENGTH) {
+                PG_lcd_bus_write_data_run(lcd, 0, (i / GPIO_BENCH_RUN_LENGTH) % PG_PAGES, 0, run, GPIO_BENCH_RUN_LENGTH);
+            }
+            break;
+        default:
+            break;
+    }
+    result->ns = PG_timing_now_ns() - begin_ns;
+
+    const struct PG_bus_counters_t *end_counters = &lcd->lines->counters;
+    result->transitions = end_counters->pin_writes - begin_counters.pin_writes;
+    result->bytes = end_counters->bytes - begin_counters.bytes;
+    result->pulses = end_counters->pulses - begin_counters.pulses;
+    // backend op를 직접 부르면 counter에 남지 않는다
+    if(op == GPIO_BENCH_PIN_SET_VAL) {
+        result->transitions = count;
+    }
+    if(op == GPIO_BENCH_WRITE_DATA_BIT) {
+        result->bytes = count;
+    }
+}
+
+static int gpio_bench_backend(PG_backend_t backend, int count)
+{
+    struct PG_lcd_t lcd;
+    PG_lcd_initialize(&lcd, backend);
+    PG_lcd_set_default_pins(&lcd);
+    if(backend != PG_BACKEND_EMU) {
+        uint32_t busy_timeout = lcd.timing.t_busy_timeout;
+        memset(&lcd.timing, 0, sizeof(lcd.timing));
+        lcd.timing.t_busy_timeout = busy_timeout;
+    }
+    if(lcd.setup(&lcd, PG_PINMAP_PHYS)) {
+        fprintf(stderr, "%s: setup failed, skip\n", PG_backend_name(backend));
+        PG_lcd_destroy(&lcd);
+        return 1;
+    }
+    // 선택된 chip이 없어야 write_bus가 busy flag를 읽지 않는다
+    PG_lcd_pin_set(&lcd, lcd.pin_cs1, 0);
+    PG_lcd_pin_set(&lcd, lcd.pin_cs2, 0);
+    lcd.selected_chip = -1;
+
+    for(int op = 0 ; op < GPIO_BENCH_OP_MAX_COUNT ; ++op) {
+        struct gpio_bench_result_t best;
+        memset(&best, 0, sizeof(best));
+        best.ns = UINT64_MAX;
+        for(int round = 0 ; round < GPIO_BENCH_ROUNDS ; ++round) {
+            struct gpio_bench_result_t result;
+            gpio_bench_run_op(&lcd, op, count, &result);
+            if(result.ns < best.ns) {
+                best = result;
+            }
+        }
+        double sec = best.ns > 0 ? best.ns / 1000000000.0 : 1e-9;
+        printf("%s,%s,%d,%.1f,%.0f,%.0f,%.0f\n",
+               PG_backend_name(backend),
+               op_name_list[op],
+               count,
+               best.ns / (double)count,
+               best.transitions / sec,
+               best.bytes / sec,
+               best.pulses / sec);
+        fflush(stdout);
+    }
+
+    PG_lcd_destroy(&lcd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = GPIO_BENCH_DEFAULT_COUNT;
+    if(argc >= 2) {
+        count = atoi(argv[1]);
+    }
+    if(count <= 0) {
+        fprintf(stderr, "usage: %s [count] [gpio|gpiomem|dummy|emu|glfw ...]\n", argv[0]);
+        return 1;
+    }
+
+    // glfw는 창을 띄우므로 이름을 줄때만 돈다
+    bool enabled[PG_BACKEND_MAX_COUNT] = { false };
+    if(argc >= 3) {
+        for(int i = 2 ; i < argc ; ++i) {
+            bool found = false;
+            for(int backend = 0 ; backend < PG_BACKEND_MAX_COUNT ; ++backend) {
+                if(strcmp(argv[i], PG_backend_name(backend)) == 0) {
+                    enabled[backend] = true;
+                    found = true;
+                }
+            }
+            if(!found) {
+                fprintf(stderr, "unknown backend : %s\n", argv[i]);
+                return 1;
+            }
+        }
+    } else {
+        enabled[PG_BACKEND_GPIO] = true;
+        enabled[PG_BACKEND_GPIOMEM] = true;
+        enabled[PG_BACKEND_DUMMY] = true;
+        enabled[PG_BACKEND_EMU] = true;
+    }
+
+    printf("backend,op,count,ns_per_op,transitions_per_sec,bytes_per_sec,pulses_per_sec\n");
+    for(int backend = 0 ; backend < PG_BACKEND_MAX_COUNT ; ++backend) {
+        if(enabled[backend]) {
+            gpio_bench_backend(backend, count);
+        }
+    }
+    return 0;
+}
@@ -3,33 +3,27 @@
 #include <string.h>
 #include <stdio.h>
 
+// 항상 켜두고 끝날때 남긴다. ./replay piglcd.trace 로 다시 볼수 있다
+static struct PG_trace_t trace;
+
 int main()
 {
     struct PG_lcd_t lcd;
 #ifdef __arm__
     PG_lcd_initialize(&lcd, PG_BACKEND_GPIO);
+#elif defined(PG_NO_GLFW)
+    PG_lcd_initialize(&lcd, PG_BACKEND_EMU);
 #else
     PG_lcd_initialize(&lcd, PG_BACKEND_GLFW);
 #endif
-    lcd.pin_rs = 24;
-    lcd.pin_e = 26;
-    lcd.pin_d0 = 3;
-    lcd.pin_d1 = 5;
-    lcd.pin_d2 = 7;
-    lcd.pin_d3 = 11;
-    lcd.pin_d4 = 13;
-    lcd.pin_d5 = 15;
-    lcd.pin_d6 = 19;
-    lcd.pin_d7 = 21;
-    lcd.pin_cs1 = 16;
-    lcd.pin_cs2 = 18;
-    lcd.pin_rst = 8;
-    lcd.pin_led = 12;
+    PG_lcd_set_default_pins(&lcd);
 
+    PG_trace_attach(&trace, &lcd);
     lcd.setup(&lcd, PG_PINMAP_PHYS);
     PG_lcd_commit_buffer(&lcd);
 
     struct PG_framebuffer_t buffer;
+    PG_framebuffer_initialize(&buffer, lcd.columns);
     /*
     for(int i = 0 ; i < 50 ; ++i) {
         PG_framebuffer_write_sample_pattern(&buffer);
@@ -46,7 +40,7 @@ int main()
     /*
     int running = 1;
     for(int page = 0 ; page < PG_PAGES * 100 && running ; ++page) {
-        for(int column = 0 ; column < PG_COLUMNS && running ; ++column) {
+        for(int column = 0 ; column < PG_DEFAULT_COLUMNS && running ; ++column) {
             PG_framebuffer_clear(&buffer);
             buffer.data[PG_BUFFER_INDEX(page, column)] = 0b10101010;
             PG_lcd_render_buffer(&lcd, &buffer);
@@ -58,14 +52,32 @@ int main()
         }
     }
     */
-    for(;;) {
+    const int REPORT_INTERVAL = 100;
+    for(int frame = 1 ; ; ++frame) {
         PG_framebuffer_write_test(&buffer);
         PG_lcd_render_buffer(&lcd, &buffer);
         //memcpy(&lcd.buffer, &buffer, sizeof(buffer));
         //PG_lcd_commit_buffer(&lcd);
         if(!lcd.is_alive(&lcd)) break;
+
+        if(frame % REPORT_INTERVAL == 0) {
+            struct PG_metrics_report_t report;
+            PG_lcd_get_metrics(&lcd, &report);
+            printf("frame time p50 = %.3f ms, p99 = %.3f ms, max = %.3f ms, pulses/frame = %.1f\n",
+                   report.frame_time_p50_ns / 1000000.0,
+                   report.frame_time_p99_ns / 1000000.0,
+                   report.frame_time_max_ns / 1000000.0,
+                   report.pulses_per_frame);
+            printf("write amplification = %.2f bus bytes / changed byte\n", report.write_amplification);
+            if(lcd.backend == PG_BACKEND_EMU) {
+                printf("emu frame time avg = %.3f ms\n", lcd.emu_total_frame_ns / (double)lcd.emu_frame_count / 1000000.0);
+            }
+            fflush(stdout);
+        }
     }
 
+    PG_trace_detach(&trace);
+    PG_trace_dump(&trace, "piglcd.trace");
     PG_lcd_destroy(&lcd);
 
     return 0;
@@ -4,18 +4,58 @@
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "font5x8.h"
 
+// diff engine
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "ArduinoIcon64x64.h"
 
 // for glfw backend
+#ifndef PG_NO_GLFW
 #include <GLFW/glfw3.h>
+#else
+// headless build. glfw backend는 setup에서 실패하므로 emu backend를 쓴다
+#define GL_COLOR_BUFFER_BIT 0
+#define GL_PROJECTION 0
+#define GL_MODELVIEW 0
+#define GL_TRIANGLES 0
+#define GL_LINES 0
+typedef struct GLFWwindow GLFWwindow;
+static int glfwInit() { fprintf(stderr, "GLFW not built, use emu backend.\n"); return 0; }
+static void glfwTerminate() {}
+static GLFWwindow *glfwCreateWindow(int w, int h, const char *title, void *monitor, void *share) { UNUSED(w); UNUSED(h); UNUSED(title); UNUSED(monitor); UNUSED(share); return NULL; }
+static void glfwDestroyWindow(GLFWwindow *window) { UNUSED(window); }
+static void glfwMakeContextCurrent(GLFWwindow *window) { UNUSED(window); }
+static void glfwSwapInterval(int interval) { UNUSED(interval); }
+static void glfwSwapBuffers(GLFWwindow *window) { UNUSED(window); }
+static void glfwPollEvents() {}
+static int glfwWindowShouldClose(GLFWwindow *window) { UNUSED(window); return 1; }
+static void glViewport(int x, int y, int w, int h) { UNUSED(x); UNUSED(y); UNUSED(w); UNUSED(h); }
+static void glClear(int mask) { UNUSED(mask); }
+static void glMatrixMode(int mode) { UNUSED(mode); }
+static void glLoadIdentity() {}
+static void glOrtho(double l, double r, double b, double t, double n, double f) { UNUSED(l); UNUSED(r); UNUSED(b); UNUSED(t); UNUSED(n); UNUSED(f); }
+static void glColor3f(float r, float g, float b) { UNUSED(r); UNUSED(g); UNUSED(b); }
+static void glBegin(int mode) { UNUSED(mode); }
+static void glEnd() {}
+static void glVertex3f(float x, float y, float z) { UNUSED(x); UNUSED(y); UNUSED(z); }
+#endif
 
 // for gpip backend
 #ifdef __arm__
 #include <wiringPi.h>
 #else
 const int OUTPUT = 0;
+const int INPUT = 1;
 static int wiringPiSetupMock()
 {
     fprintf(stderr, "WiringPi not exist, use Mock.\n");
@@ -28,11 +68,33 @@ static int wiringPiSetupSys() { return wiringPiSetupMock(); }
 
 static void digitalWrite(int pin, int val) { UNUSED(pin); UNUSED(val); }
 static void pinMode(int pin, int mode) { UNUSED(pin); UNUSED(mode); }
+static int digitalRead(int pin) { UNUSED(pin); return 0; }
 #endif
 
-#define PIN_COUNT 14
+// 제어선 + data pin 최대 개수
+#define PIN_COUNT 17
 #define DATA_PIN_COUNT 8
 
+// for emu backend
+// wiringPi digitalWrite 한번 정도
+#define EMU_DEFAULT_PIN_WRITE_NS 100
+
+// for gpiomem backend
+#define GPIOMEM_DEVICE "/dev/gpiomem"
+#define GPIOMEM_FAKE_PATH "/tmp/piglcd-gpiomem"
+
+// BCM2835 gpio register offset (uint32_t 단위)
+#define GPIOMEM_REG_GPFSEL0 0
+#define GPIOMEM_REG_GPSET0 7
+#define GPIOMEM_REG_GPCLR0 10
+#define GPIOMEM_REG_GPLEV0 13
+
+#define GPIOMEM_FSEL_INPUT 0b000u
+#define GPIOMEM_FSEL_OUTPUT 0b001u
+
+// GPSET0/GPCLR0 로 다룰수 있는 gpio
+#define GPIOMEM_BANK_PIN_COUNT 32
+
 // LCD size
 #define GLFW_LCD_BASE_X 0
 #define GLFW_LCD_BASE_Y 0
@@ -55,6 +117,10 @@ static void pinMode(int pin, int mode) { UNUSED(pin); UNUSED(mode); }
 #define MASK_SET_COLUMN 0b01000000
 #define DATA_BITS_SET_COLUMN 6
 
+// frame pacer
+#define PACER_DEFAULT_FPS 60
+#define PACER_DEFAULT_MAX_CATCH_UP 4
+
 // http://stackoverflow.com/questions/5167269/clock-gettime-alternative-in-mac-os-x
 #ifdef __MACH__
 #include <sys/time.h>
@@ -72,29 +138,57 @@ int clock_gettime(int clk_id, struct timespec* t) {
 #endif
 
 // helper function
-static struct timespec PG_timespec_subtract(struct timespec *a, struct timespec *b);
-static void PG_nanosleep(int nsec);
+static void PG_lcd_bus_delay_pulse(struct PG_lcd_t *lcd, void (*set_e)(struct PG_lcd_t *lcd, int val));
 
-static void PG_lcd_fill_all_pin(struct PG_lcd_t *lcd, uint8_t pin_table[PIN_COUNT]);
+static int PG_lcd_fill_all_pin(struct PG_lcd_t *lcd, uint8_t pin_table[PIN_COUNT]);
 static void PG_lcd_fill_data_pin(struct PG_lcd_t *lcd, uint8_t pin_table[DATA_PIN_COUNT]);
+static void PG_lcd_build_data_table(struct PG_lcd_t *lcd, const uint32_t line_mask[DATA_PIN_COUNT]);
 
 // gpio backend
 static void PG_lcd_gpio_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val);
 static void PG_lcd_gpio_pulse(struct PG_lcd_t *lcd);
+static int PG_lcd_gpio_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin);
+static void PG_lcd_gpio_set_data_direction(struct PG_lcd_t *lcd, int input);
 static int PG_lcd_gpio_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
 static int PG_lcd_gpio_frame_end_callback(struct PG_lcd_t *lcd);
 static bool PG_lcd_gpio_is_alive(struct PG_lcd_t *lcd);
 
+// gpiomem backend
+static void PG_lcd_gpiomem_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val);
+static void PG_lcd_gpiomem_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data);
+static void PG_lcd_gpiomem_pulse(struct PG_lcd_t *lcd);
+static int PG_lcd_gpiomem_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin);
+static void PG_lcd_gpiomem_set_data_direction(struct PG_lcd_t *lcd, int input);
+static void PG_lcd_gpiomem_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length);
+static int PG_lcd_gpiomem_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
+static int PG_lcd_gpiomem_frame_end_callback(struct PG_lcd_t *lcd);
+static bool PG_lcd_gpiomem_is_alive(struct PG_lcd_t *lcd);
+static void PG_lcd_gpiomem_destroy(struct PG_lcd_t *lcd);
+
 // dummy backend
 static void PG_lcd_dummy_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val);
 static void PG_lcd_dummy_pulse(struct PG_lcd_t *lcd);
+static int PG_lcd_dummy_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin);
 static int PG_lcd_dummy_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
 static int PG_lcd_dummy_frame_end_callback(struct PG_lcd_t *lcd);
 static bool PG_lcd_dummy_is_alive(struct PG_lcd_t *lcd);
 
+// emu backend
+static void PG_lcd_emu_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val);
+static void PG_lcd_emu_pulse(struct PG_lcd_t *lcd);
+static int PG_lcd_emu_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin);
+static void PG_lcd_emu_delay_ns(struct PG_lcd_t *lcd, uint32_t nsec);
+static int PG_lcd_emu_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
+static int PG_lcd_emu_frame_end_callback(struct PG_lcd_t *lcd);
+static bool PG_lcd_emu_is_alive(struct PG_lcd_t *lcd);
+
 // glfw backend
 static void PG_lcd_glfw_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val);
+static void PG_lcd_glfw_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data);
 static void PG_lcd_glfw_pulse(struct PG_lcd_t *lcd);
+static void PG_lcd_glfw_write_command(struct PG_lcd_t *lcd, int chip, uint8_t cmd);
+static void PG_lcd_glfw_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length);
+static void PG_lcd_glfw_chip_broadcast(struct PG_lcd_t *lcd, uint8_t cmd);
 static int PG_lcd_glfw_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
 static int PG_lcd_glfw_frame_end_callback(struct PG_lcd_t *lcd);
 static bool PG_lcd_glfw_is_alive(struct PG_lcd_t *lcd);
@@ -112,67 +206,118 @@ void PG_lcd_set_start_line(struct PG_lcd_t *lcd, int idx);
 
 void PG_lcd_select_chip(struct PG_lcd_t *lcd, int chip);
 void PG_lcd_unselect_chip(struct PG_lcd_t *lcd);
-void PG_lcd_write_data_bit(struct PG_lcd_t *lcd, uint8_t data);
 
+// byte level bus. backend가 지원하지 않으면 pin level로 처리한다
+void PG_lcd_bus_chip_broadcast(struct PG_lcd_t *lcd, uint8_t cmd);
+void PG_lcd_bus_address(struct PG_lcd_t *lcd, int chip, int page, int column);
+void PG_lcd_model_invalidate(struct PG_lcd_t *lcd);
+static int PG_lcd_check_geometry(struct PG_lcd_t *lcd);
+static uint8_t PG_lcd_chip_pin(struct PG_lcd_t *lcd, int chip);
+
+
+// render metrics
+static void PG_lcd_metrics_frame_begin(struct PG_lcd_t *lcd);
+static void PG_lcd_metrics_phase(struct PG_lcd_t *lcd, PG_phase_t phase);
+static void PG_lcd_metrics_frame_work_done(struct PG_lcd_t *lcd);
+
+// framebuffer dirty tracking
+static void PG_framebuffer_dirty_reset(struct PG_framebuffer_t *buffer);
+static void PG_framebuffer_dirty_span(struct PG_framebuffer_t *buffer, int page, int begin, int end);
+static uint64_t PG_framebuffer_column_get(const struct PG_framebuffer_t *buffer, int column);
+static void PG_framebuffer_column_set(struct PG_framebuffer_t *buffer, int column, uint64_t bits);
+
+// async render
+static int PG_lcd_start_async(struct PG_lcd_t *lcd);
+static void *PG_lcd_async_main(void *arg);
 
-static const int FPS_SAMPLING_SIZE = 100;
-struct fps_counter_t {
-    struct timespec begin_tspec;
-    int sampling_idx;
+// timing engine
+// 이 시간보다 길면 spin 대신 clock을 보면서 기다린다
+#define SPIN_CLOCK_THRESHOLD_NS 5000
+#define SPIN_CALIBRATE_LOOPS 200000
+#define SPIN_CALIBRATE_ROUNDS 5
+
+struct spin_calibration_t {
+    bool calibrated;
+    // 1024 nsec 동안 도는 loop 수
+    uint32_t loops_per_1024ns;
 };
-static struct fps_counter_t g_fps_counter;
-static void fps_counter_initialize(struct fps_counter_t *counter);
-static void fps_counter_update(struct fps_counter_t *counter);
+static struct spin_calibration_t g_spin_calibration;
 
-// helper function
-struct timespec PG_timespec_subtract(struct timespec *a, struct timespec *b)
+__attribute__((noinline)) static void PG_spin(uint32_t loops)
 {
-    struct timespec diff;
-    diff.tv_sec = a->tv_sec - b->tv_sec;
-    diff.tv_nsec = a->tv_nsec - b->tv_nsec;
-    if(diff.tv_nsec < 0) {
-        diff.tv_sec -= 1;
-        diff.tv_nsec += 1000 * 1000 * 1000;
+    for(volatile uint32_t i = 0 ; i < loops ; ++i) {
     }
-    assert(diff.tv_sec >= 0);
-    assert(diff.tv_nsec >= 0);
-    return diff;
 }
 
-static void PG_nanosleep(int nsec)
+uint64_t PG_timing_now_ns(void)
 {
-    struct timespec dt;
-    struct timespec rmtp;
-    dt.tv_sec = 0;
-    dt.tv_nsec = nsec;
-    nanosleep(&dt, &rmtp);
+    struct timespec tspec;
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (uint64_t)tspec.tv_sec * 1000000000ull + tspec.tv_nsec;
 }
 
-void fps_counter_initialize(struct fps_counter_t *counter)
+// 가장 빨리 돈 round를 쓴다. 나중에 cpu가 빨라져도 delay가 짧아지지 않게
+void PG_timing_calibrate(void)
 {
-    memset(counter, 0, sizeof(*counter));
-    counter->sampling_idx = 0;
-    clock_gettime(CLOCK_MONOTONIC, &counter->begin_tspec);
+    PG_spin(SPIN_CALIBRATE_LOOPS);
+
+    uint64_t best_ns = 0;
+    for(int round = 0 ; round < SPIN_CALIBRATE_ROUNDS ; ++round) {
+        uint64_t begin = PG_timing_now_ns();
+        PG_spin(SPIN_CALIBRATE_LOOPS);
+        uint64_t elapsed = PG_timing_now_ns() - begin;
+        if(elapsed > 0 && (best_ns == 0 || elapsed < best_ns)) {
+            best_ns = elapsed;
+        }
+    }
+    if(best_ns == 0) {
+        best_ns = 1;
+    }
+
+    uint64_t loops = (uint64_t)SPIN_CALIBRATE_LOOPS * 1024 / best_ns;
+    g_spin_calibration.loops_per_1024ns = (loops > 0) ? (uint32_t)loops : 1;
+    g_spin_calibration.calibrated = true;
 }
 
-void fps_counter_update(struct fps_counter_t *counter)
+void PG_delay_ns(uint32_t nsec)
 {
-    counter->sampling_idx += 1;
-    if(counter->sampling_idx < FPS_SAMPLING_SIZE) {
+    if(nsec == 0) {
         return;
     }
+    if(nsec >= SPIN_CLOCK_THRESHOLD_NS) {
+        uint64_t deadline = PG_timing_now_ns() + nsec;
+        while(PG_timing_now_ns() < deadline) {
+        }
+        return;
+    }
+    uint64_t loops = ((uint64_t)nsec * g_spin_calibration.loops_per_1024ns + 1023) / 1024;
+    PG_spin((uint32_t)loops);
+}
 
-    struct timespec end_tspec;
-    clock_gettime(CLOCK_MONOTONIC, &end_tspec);
+// backend가 시간을 흉내내면 (emu) 실제로 기다리지 않는다
+static void PG_lcd_delay(struct PG_lcd_t *lcd, uint32_t nsec)
+{
+    if(lcd->delay_ns != NULL) {
+        lcd->delay_ns(lcd, nsec);
+    } else {
+        PG_delay_ns(nsec);
+    }
+}
 
-    struct timespec diff = PG_timespec_subtract(&end_tspec, &counter->begin_tspec);
-    float sec = ((diff.tv_sec) + (diff.tv_nsec / 1000000000.0)) / FPS_SAMPLING_SIZE;
-    float fps = 1.0 / sec;
-    printf("Avg FPS = %f, Avg delta = %f sec\n", fps, sec);
-    fflush(stdout);
+// tAS 이후에 E를 올리고, tPWH/tDSW 동안 유지하고, 내린 다음 tPWL을 지킨다
+void PG_lcd_bus_delay_pulse(struct PG_lcd_t *lcd, void (*set_e)(struct PG_lcd_t *lcd, int val))
+{
+    const struct PG_timing_t *timing = &lcd->timing;
+    uint32_t high_ns = timing->t_pwh;
+    if(timing->t_dsw > timing->t_as + high_ns) {
+        high_ns = timing->t_dsw - timing->t_as;
+    }
 
-    memcpy(&counter->begin_tspec, &end_tspec, sizeof(end_tspec));
-    counter->sampling_idx = 0;
+    PG_lcd_delay(lcd, timing->t_as);
+    set_e(lcd, 1);
+    PG_lcd_delay(lcd, high_ns);
+    set_e(lcd, 0);
+    PG_lcd_delay(lcd, timing->t_pwl);
 }
 
 // gpio backend
@@ -181,15 +326,32 @@ void PG_lcd_gpio_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
     UNUSED(lcd);
     digitalWrite(pin, val);
 }
+static void PG_lcd_gpio_set_e(struct PG_lcd_t *lcd, int val)
+{
+    PG_lcd_pin_set(lcd, lcd->pin_e, val);
+}
 void PG_lcd_gpio_pulse(struct PG_lcd_t *lcd)
 {
-    PG_lcd_pin_on(lcd, lcd->pin_e);
-    // sleep short time
-    PG_nanosleep(1);
-    PG_lcd_pin_off(lcd, lcd->pin_e);
+    PG_lcd_bus_delay_pulse(lcd, PG_lcd_gpio_set_e);
+}
+int PG_lcd_gpio_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin)
+{
+    UNUSED(lcd);
+    return digitalRead(pin);
+}
+void PG_lcd_gpio_set_data_direction(struct PG_lcd_t *lcd, int input)
+{
+    uint8_t data_pin_table[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_table);
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        pinMode(data_pin_table[i], input ? INPUT : OUTPUT);
+    }
 }
 int PG_lcd_gpio_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
 {
+    if(PG_lcd_check_geometry(lcd) != 0) {
+        return 1;
+    }
     int success = -1;
     switch(pinmap_type) {
         case PG_PINMAP_NORMAL:
@@ -213,11 +375,12 @@ int PG_lcd_gpio_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
     }
 
     uint8_t pin_array[PIN_COUNT];
-    PG_lcd_fill_all_pin(lcd, pin_array);
-    for(int i = 0 ; i < PIN_COUNT ; ++i) {
+    int pin_count = PG_lcd_fill_all_pin(lcd, pin_array);
+    for(int i = 0 ; i < pin_count ; ++i) {
         uint8_t pin = pin_array[i];
         pinMode(pin, OUTPUT);
     }
+    PG_lcd_build_data_table(lcd, NULL);
 
     // common setup
     PG_lcd_pin_all_low(lcd);
@@ -239,21 +402,307 @@ bool PG_lcd_gpio_is_alive(struct PG_lcd_t *lcd)
     return true;
 }
 
+// gpiomem backend
+// wiringPi/physical header pin -> BCM gpio. -1 = not a gpio
+static const int8_t GPIOMEM_WPI_TO_BCM[] = {
+    17, 18, 27, 22, 23, 24, 25, 4,
+    2, 3, 8, 7, 10, 9, 11, 14,
+    15, 28, 29, 30, 31, 5, 6, 13,
+    19, 26, 12, 16, 20, 21, 0, 1,
+};
+static const int8_t GPIOMEM_PHYS_TO_BCM[] = {
+    -1,
+    -1, -1, 2, -1, 3, -1, 4, 14, -1, 15,
+    17, 18, 27, -1, 22, 23, -1, 24, 10, -1,
+    9, 25, 11, 8, -1, 7, 0, 1, 5, -1,
+    6, 12, 13, -1, 19, 16, 26, 20, -1, 21,
+};
+
+static int PG_gpiomem_bcm_from_pin(PG_pinmap_t pinmap_type, int pin)
+{
+    int count = 0;
+    switch(pinmap_type) {
+        case PG_PINMAP_NORMAL:
+            count = sizeof(GPIOMEM_WPI_TO_BCM) / sizeof(GPIOMEM_WPI_TO_BCM[0]);
+            return (pin < count) ? GPIOMEM_WPI_TO_BCM[pin] : -1;
+        case PG_PINMAP_PHYS:
+            count = sizeof(GPIOMEM_PHYS_TO_BCM) / sizeof(GPIOMEM_PHYS_TO_BCM[0]);
+            return (pin < count) ? GPIOMEM_PHYS_TO_BCM[pin] : -1;
+        case PG_PINMAP_GPIO:
+        case PG_PINMAP_SYS:
+            return pin;
+        default:
+            return -1;
+    }
+}
+
+// GPSET0/GPCLR0에 한번씩 쓰면 32개 gpio를 동시에 바꿀수 있다
+static inline void PG_gpiomem_write(struct PG_lcd_t *lcd, uint32_t set_mask, uint32_t clr_mask)
+{
+    volatile uint32_t *base = lcd->gpiomem_base;
+    if(set_mask) {
+        base[GPIOMEM_REG_GPSET0] = set_mask;
+    }
+    if(clr_mask) {
+        base[GPIOMEM_REG_GPCLR0] = clr_mask;
+    }
+    // 가짜 레지스터는 출력 레벨을 GPLEV0에 흉내낸다
+    if(lcd->gpiomem_fake) {
+        uint32_t level = base[GPIOMEM_REG_GPLEV0];
+        base[GPIOMEM_REG_GPLEV0] = (level | set_mask) & ~clr_mask;
+    }
+}
+
+// GPFSEL : gpio 하나당 3bit
+static void PG_gpiomem_set_function(struct PG_lcd_t *lcd, int bcm, uint32_t function)
+{
+    volatile uint32_t *fsel = lcd->gpiomem_base + GPIOMEM_REG_GPFSEL0 + (bcm / 10);
+    int shift = (bcm % 10) * 3;
+    *fsel = (*fsel & ~(0b111u << shift)) | (function << shift);
+}
+
+void PG_lcd_gpiomem_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    if(pin >= PG_GPIOMEM_PIN_TABLE_SIZE || lcd->gpiomem_bcm_pin[pin] < 0) {
+        return;
+    }
+    uint32_t mask = 1u << lcd->gpiomem_bcm_pin[pin];
+    if(val) {
+        PG_gpiomem_write(lcd, mask, 0);
+    } else {
+        PG_gpiomem_write(lcd, 0, mask);
+    }
+}
+void PG_lcd_gpiomem_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data)
+{
+    uint32_t rs_set = lcd->gpiomem_rs_mask & -(uint32_t)(rs != 0);
+    uint32_t rs_clr = lcd->gpiomem_rs_mask & ~rs_set;
+    uint32_t set_mask = lcd->data_table.set_mask[data] | rs_set;
+    uint32_t clr_mask = lcd->data_table.clr_mask[data] | rs_clr;
+    PG_gpiomem_write(lcd, set_mask, clr_mask);
+}
+int PG_lcd_gpiomem_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin)
+{
+    if(pin >= PG_GPIOMEM_PIN_TABLE_SIZE || lcd->gpiomem_bcm_pin[pin] < 0) {
+        return 0;
+    }
+    uint32_t level = lcd->gpiomem_base[GPIOMEM_REG_GPLEV0];
+    return (level >> lcd->gpiomem_bcm_pin[pin]) & 1;
+}
+void PG_lcd_gpiomem_set_data_direction(struct PG_lcd_t *lcd, int input)
+{
+    uint8_t data_pin_table[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_table);
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        int bcm = lcd->gpiomem_bcm_pin[data_pin_table[i]];
+        PG_gpiomem_set_function(lcd, bcm, input ? GPIOMEM_FSEL_INPUT : GPIOMEM_FSEL_OUTPUT);
+    }
+    // 가짜 레지스터에서는 입력으로 바꾼 data pin이 pull-down된 것처럼 보인다 (= ready)
+    if(lcd->gpiomem_fake && input) {
+        lcd->gpiomem_base[GPIOMEM_REG_GPLEV0] &= ~lcd->data_table.set_mask[0xFF];
+    }
+}
+static void PG_lcd_gpiomem_set_e(struct PG_lcd_t *lcd, int val)
+{
+    lcd->lines->counters.pin_writes++;
+    if(val) {
+        PG_gpiomem_write(lcd, lcd->gpiomem_e_mask, 0);
+    } else {
+        PG_gpiomem_write(lcd, 0, lcd->gpiomem_e_mask);
+    }
+}
+void PG_lcd_gpiomem_pulse(struct PG_lcd_t *lcd)
+{
+    PG_lcd_bus_delay_pulse(lcd, PG_lcd_gpiomem_set_e);
+}
+void PG_lcd_gpiomem_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length)
+{
+    if(length <= 0) {
+        return;
+    }
+    PG_lcd_bus_address(lcd, chip, page, column);
+
+    // RS는 run 동안 high로 고정, byte마다 GPSET0/GPCLR0 + E pulse
+    const struct PG_data_table_t *table = &lcd->data_table;
+    uint32_t rs_mask = lcd->gpiomem_rs_mask;
+    bool busy_poll = PG_lcd_can_read_status(lcd);
+    uint8_t prev = lcd->lines->data_valid ? lcd->lines->data : (uint8_t)~data[0];
+    for(int i = 0 ; i < length ; ++i) {
+        if(busy_poll) {
+            PG_lcd_wait_ready(lcd, chip);
+        }
+        uint8_t elem = data[i];
+        PG_gpiomem_write(lcd, table->set_mask[elem] | rs_mask, table->clr_mask[elem]);
+        PG_lcd_gpiomem_pulse(lcd);
+        lcd->lines->counters.pin_writes += table->pin_count[prev ^ elem];
+        prev = elem;
+    }
+    lcd->lines->counters.pin_writes += (lcd->lines->pin_shadow[lcd->pin_rs] != 1);
+
+    lcd->lines->pin_shadow[lcd->pin_rs] = 1;
+    lcd->lines->data = data[length - 1];
+    lcd->lines->data_valid = true;
+}
+int PG_lcd_gpiomem_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
+{
+    if(PG_lcd_check_geometry(lcd) != 0) {
+        return 1;
+    }
+    // lcd pin number -> BCM gpio
+    memset(lcd->gpiomem_bcm_pin, -1, sizeof(lcd->gpiomem_bcm_pin));
+    uint8_t pin_array[PIN_COUNT];
+    int pin_count = PG_lcd_fill_all_pin(lcd, pin_array);
+    for(int i = 0 ; i < pin_count ; ++i) {
+        uint8_t pin = pin_array[i];
+        int bcm = -1;
+        if(pin < PG_GPIOMEM_PIN_TABLE_SIZE) {
+            bcm = PG_gpiomem_bcm_from_pin(pinmap_type, pin);
+        }
+        if(bcm < 0 || bcm >= GPIOMEM_BANK_PIN_COUNT) {
+            fprintf(stderr, "gpiomem backend: pin %d is not usable\n", pin);
+            return 1;
+        }
+        lcd->gpiomem_bcm_pin[pin] = bcm;
+    }
+
+    uint8_t data_pin_table[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_table);
+    uint32_t line_mask[DATA_PIN_COUNT];
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        line_mask[i] = 1u << lcd->gpiomem_bcm_pin[data_pin_table[i]];
+    }
+    PG_lcd_build_data_table(lcd, line_mask);
+    lcd->gpiomem_rs_mask = 1u << lcd->gpiomem_bcm_pin[lcd->pin_rs];
+    lcd->gpiomem_e_mask = 1u << lcd->gpiomem_bcm_pin[lcd->pin_e];
+
+    // map register window
+    const char *path = lcd->gpiomem_path;
+    if(path == NULL) {
+#ifdef __arm__
+        path = GPIOMEM_DEVICE;
+#else
+        path = GPIOMEM_FAKE_PATH;
+#endif
+    }
+    // 실제 장치가 없을때 빈 파일이 생기면 안된다
+    int flags = O_RDWR | O_SYNC;
+    if(strcmp(path, GPIOMEM_DEVICE) != 0) {
+        flags |= O_CREAT;
+    }
+    int fd = open(path, flags, 0644);
+    if(fd < 0) {
+        fprintf(stderr, "gpiomem backend: cannot open %s\n", path);
+        return 1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return 1;
+    }
+    lcd->gpiomem_fake = S_ISREG(st.st_mode);
+    if(lcd->gpiomem_fake && st.st_size < PG_GPIOMEM_BLOCK_SIZE) {
+        if(ftruncate(fd, PG_GPIOMEM_BLOCK_SIZE) != 0) {
+            close(fd);
+            return 1;
+        }
+    }
+    void *base = mmap(NULL, PG_GPIOMEM_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED) {
+        fprintf(stderr, "gpiomem backend: cannot mmap %s\n", path);
+        close(fd);
+        return 1;
+    }
+    lcd->gpiomem_fd = fd;
+    lcd->gpiomem_base = (volatile uint32_t *)base;
+
+    for(int i = 0 ; i < pin_count ; ++i) {
+        PG_gpiomem_set_function(lcd, lcd->gpiomem_bcm_pin[pin_array[i]], GPIOMEM_FSEL_OUTPUT);
+    }
+
+    // common setup
+    PG_lcd_pin_all_low(lcd);
+    PG_lcd_reset(lcd);
+
+    PG_lcd_set_display_enable(lcd, 1);
+    PG_lcd_set_start_line(lcd, 0);
+
+    return 0;
+}
+int PG_lcd_gpiomem_frame_end_callback(struct PG_lcd_t *lcd)
+{
+    UNUSED(lcd);
+    return 0;
+}
+bool PG_lcd_gpiomem_is_alive(struct PG_lcd_t *lcd)
+{
+    UNUSED(lcd);
+    return true;
+}
+void PG_lcd_gpiomem_destroy(struct PG_lcd_t *lcd)
+{
+    if(lcd->gpiomem_base != NULL) {
+        munmap((void *)lcd->gpiomem_base, PG_GPIOMEM_BLOCK_SIZE);
+        lcd->gpiomem_base = NULL;
+    }
+    if(lcd->gpiomem_fd >= 0) {
+        close(lcd->gpiomem_fd);
+        lcd->gpiomem_fd = -1;
+    }
+}
+
 // dummy backend
+// busy flag를 테스트할수 있게 RW/CS와 명령 처리 시간만 흉내낸다
 void PG_lcd_dummy_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
 {
-    UNUSED(lcd);
-    UNUSED(pin);
-    UNUSED(val);
+    if(pin == lcd->pin_rw) {
+        lcd->dummy_val_rw = val;
+        return;
+    }
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(pin == PG_lcd_chip_pin(lcd, chip)) {
+            lcd->dummy_val_cs[chip] = val;
+        }
+    }
 }
 void PG_lcd_dummy_pulse(struct PG_lcd_t *lcd)
 {
-    UNUSED(lcd);
+    // delay는 없지만 E는 다른 backend처럼 shadow를 거쳐 움직여서 pin counter를 맞춘다
+    PG_lcd_pin_set(lcd, lcd->pin_e, 1);
+    PG_lcd_pin_set(lcd, lcd->pin_e, 0);
+    if(lcd->dummy_val_rw) {
+        return;
+    }
+    // busy를 읽을 수 없거나 busy 시간이 없으면 시계를 읽을 필요도 없다
+    if(lcd->pin_rw == PG_PIN_NONE || lcd->timing.t_busy == 0) {
+        return;
+    }
+    uint64_t busy_until = PG_timing_now_ns() + lcd->timing.t_busy;
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(lcd->dummy_val_cs[chip]) {
+            lcd->dummy_busy_until[chip] = busy_until;
+        }
+    }
+}
+int PG_lcd_dummy_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin)
+{
+    if(pin != lcd->pin_d7 || !lcd->dummy_val_rw) {
+        return 0;
+    }
+    uint64_t now = PG_timing_now_ns();
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(lcd->dummy_val_cs[chip] && now < lcd->dummy_busy_until[chip]) {
+            return 1;
+        }
+    }
+    return 0;
 }
 int PG_lcd_dummy_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
 {
-    UNUSED(lcd);
     UNUSED(pinmap_type);
+    if(PG_lcd_check_geometry(lcd) != 0) {
+        return 1;
+    }
+    PG_lcd_build_data_table(lcd, NULL);
     return 0;
 }
 int PG_lcd_dummy_frame_end_callback(struct PG_lcd_t *lcd)
@@ -268,95 +717,391 @@ bool PG_lcd_dummy_is_alive(struct PG_lcd_t *lcd)
 }
 
 
-// glfw backend
-void PG_lcd_glfw_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
+// emu backend
+const char *PG_emu_check_name(PG_emu_check_t check)
 {
-    struct pin_tuple_t {
-        uint8_t pin;
-        uint8_t* addr;
+    const char *name_list[PG_EMU_CHECK_MAX_COUNT] = {
+        "t_as", "t_pwh", "t_pwl", "t_dsw", "t_ah", "t_dhw", "t_ddr", "busy", "model",
     };
-    struct pin_tuple_t pin_tuple_list[] = {
-        { lcd->pin_rs, &lcd->glfw_val_rs },
-        { lcd->pin_e, &lcd->glfw_val_e },
-        { lcd->pin_cs1, &lcd->glfw_val_cs1 },
-        { lcd->pin_cs2, &lcd->glfw_val_cs2 },
-        { lcd->pin_rst, &lcd->glfw_val_rst },
-        { lcd->pin_led, &lcd->glfw_val_led },
-    };
-    int count = sizeof(pin_tuple_list) / sizeof(pin_tuple_list[0]);
-    for(int i = 0 ; i < count ; ++i) {
-        if(pin_tuple_list[i].pin == pin) {
-            *pin_tuple_list[i].addr = val;
-            return;
-        }
+    assert(check >= 0 && check < PG_EMU_CHECK_MAX_COUNT);
+    return name_list[check];
+}
+
+// 처음 한번만 알리고 나머지는 세기만 한다
+static void PG_lcd_emu_violation(struct PG_lcd_t *lcd, PG_emu_check_t check, uint64_t actual_ns)
+{
+    if(lcd->emu_violation_count[check]++ == 0) {
+        fprintf(stderr, "emu backend: %s violation at %llu ns (%llu ns)\n",
+                PG_emu_check_name(check),
+                (unsigned long long)lcd->emu_now_ns,
+                (unsigned long long)actual_ns);
     }
+}
 
-    // data bits는 별도 처리
-    uint8_t data_pin_list[DATA_PIN_COUNT];
-    PG_lcd_fill_data_pin(lcd, data_pin_list);
-    for(int i = 0 ; i < 8 ; ++i) {
-        if(data_pin_list[i] == pin) {
-            uint8_t base_mask = 1 << i;
-            if(val) {
-                lcd->glfw_val_data_bits |= base_mask;
-            } else {
-                lcd->glfw_val_data_bits &= ~base_mask;
+// render가 끝나면 panel RAM 전체가 lcd->buffer와 같아야 한다
+// dirty 구간 밖에 잘못 쓴 byte도 여기서 잡힌다
+static void PG_lcd_emu_check_model(struct PG_lcd_t *lcd)
+{
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        for(int column = 0 ; column < lcd->columns ; ++column) {
+            const struct PG_emu_chip_t *chip = &lcd->emu_chip[column / PG_CHIP_COLUMNS];
+            if(chip->ram[page][column % PG_CHIP_COLUMNS] != lcd->buffer.data[PG_BUFFER_INDEX(page, column)]) {
+                PG_lcd_emu_violation(lcd, PG_EMU_CHECK_MODEL, 0);
+                return;
             }
         }
     }
 }
 
-void PG_lcd_glfw_pulse(struct PG_lcd_t *lcd)
+// pin 읽기/쓰기 하나만큼 emu 시간을 보낸다
+static void PG_lcd_emu_tick(struct PG_lcd_t *lcd)
 {
-    UNUSED(lcd);
-
-    /*
-    printf("RS  = %d\n", glfw_val_rs);
-    printf("E   = %d\n", glfw_val_e);
-    printf("D0  = %d\n", glfw_val_d0);
-    printf("D1  = %d\n", glfw_val_d1);
-    printf("D2  = %d\n", glfw_val_d2);
-    printf("D3  = %d\n", glfw_val_d3);
-    printf("D4  = %d\n", glfw_val_d4);
-    printf("D5  = %d\n", glfw_val_d5);
-    printf("D6  = %d\n", glfw_val_d6);
-    printf("D7  = %d\n", glfw_val_d7);
-    printf("CS1 = %d\n", glfw_val_cs1);
-    printf("CS2 = %d\n", glfw_val_cs2);
-    printf("RST = %d\n", glfw_val_rst);
-    printf("LED = %d\n", glfw_val_led);
-    */
-
-    uint8_t data_bits = lcd->glfw_val_data_bits;
+    lcd->emu_now_ns += lcd->emu_pin_write_ns;
+}
 
-    if(lcd->glfw_val_cs1 == 1) {
-        lcd->glfw_state_chip = 0;
+static void PG_lcd_emu_exec(struct PG_emu_chip_t *chip, int rs, uint8_t data_bits)
+{
+    if(rs) {
+        chip->ram[chip->page][chip->column] = data_bits;
+        chip->column = (chip->column + 1) % PG_CHIP_COLUMNS;
+        return;
     }
-    if(lcd->glfw_val_cs2 == 1) {
-        lcd->glfw_state_chip = 1;
+    if((data_bits >> DATA_BITS_SET_DISPLAY_ENABLE) == (MASK_SET_DISPLAY_ENABLE >> DATA_BITS_SET_DISPLAY_ENABLE)) {
+        chip->display_enable = data_bits & 1;
+    } else if((data_bits >> DATA_BITS_SET_COLUMN) == (MASK_SET_COLUMN >> DATA_BITS_SET_COLUMN)) {
+        chip->column = data_bits & ((1 << DATA_BITS_SET_COLUMN) - 1);
+    } else if((data_bits >> DATA_BITS_SET_PAGE) == (MASK_SET_PAGE >> DATA_BITS_SET_PAGE)) {
+        chip->page = data_bits & ((1 << DATA_BITS_SET_PAGE) - 1);
+    } else if((data_bits >> DATA_BITS_SET_START_LINE) == (MASK_SET_START_LINE >> DATA_BITS_SET_START_LINE)) {
+        chip->start_line = data_bits & ((1 << DATA_BITS_SET_START_LINE) - 1);
     }
-    //printf("curr chip : %d\n", glfw_state_chip);
+}
 
-    if(lcd->glfw_val_rs == 0) {
-        int shift = 0;
-        // display on/off
-        shift = DATA_BITS_SET_DISPLAY_ENABLE;
-        if((data_bits >> shift) == (MASK_SET_DISPLAY_ENABLE >> shift)) {
-            lcd->glfw_state_display_enable = ((1 << shift) - 1) & data_bits;
-            //printf("display on/off : %d\n", glfw_state_display_enable);
+// E가 내려갈때 CS가 켜진 chip이 bus 값을 받는다
+static void PG_lcd_emu_latch(struct PG_lcd_t *lcd)
+{
+    if(!lcd->emu_val_rst || lcd->emu_val_rw) {
+        return;
+    }
+    for(int i = 0 ; i < lcd->chips ; ++i) {
+        struct PG_emu_chip_t *chip = &lcd->emu_chip[i];
+        if(!lcd->emu_val_cs[i]) {
+            continue;
         }
-
-        // set column
-        shift = DATA_BITS_SET_COLUMN;
-        if((data_bits >> shift) == (MASK_SET_COLUMN >> shift)) {
-            lcd->glfw_state_column = ((1 << shift) - 1) & data_bits;
-            //printf("set column : %d\n", glfw_state_column);
+        if(lcd->emu_now_ns < chip->busy_until_ns) {
+            PG_lcd_emu_violation(lcd, PG_EMU_CHECK_BUSY, chip->busy_until_ns - lcd->emu_now_ns);
+            continue;
         }
+        PG_lcd_emu_exec(chip, lcd->emu_val_rs, lcd->emu_val_data_bits);
+        chip->busy_until_ns = lcd->emu_now_ns + lcd->emu_timing.t_busy;
+    }
+}
 
-        // set page
-        shift = DATA_BITS_SET_PAGE;
-        if((data_bits >> shift) == (MASK_SET_PAGE >> shift)) {
-            lcd->glfw_state_page = ((1 << shift) - 1) & data_bits;
+static void PG_lcd_emu_set_e(struct PG_lcd_t *lcd, int val)
+{
+    const struct PG_timing_t *timing = &lcd->emu_timing;
+    uint64_t now = lcd->emu_now_ns;
+    if(val == lcd->emu_val_e) {
+        return;
+    }
+    lcd->emu_val_e = val;
+    if(val) {
+        if(now - lcd->emu_address_ns < timing->t_as) {
+            PG_lcd_emu_violation(lcd, PG_EMU_CHECK_AS, now - lcd->emu_address_ns);
+        }
+        if(lcd->emu_fall_ns > 0 && now - lcd->emu_fall_ns < timing->t_pwl) {
+            PG_lcd_emu_violation(lcd, PG_EMU_CHECK_PWL, now - lcd->emu_fall_ns);
+        }
+        lcd->emu_rise_ns = now;
+        return;
+    }
+    if(now - lcd->emu_rise_ns < timing->t_pwh) {
+        PG_lcd_emu_violation(lcd, PG_EMU_CHECK_PWH, now - lcd->emu_rise_ns);
+    }
+    if(!lcd->emu_val_rw && now - lcd->emu_data_ns < timing->t_dsw) {
+        PG_lcd_emu_violation(lcd, PG_EMU_CHECK_DSW, now - lcd->emu_data_ns);
+    }
+    lcd->emu_fall_ns = now;
+    PG_lcd_emu_latch(lcd);
+}
+
+// RS/RW/CS는 E가 high인 동안과 내려간 직후 t_ah 동안 바뀌면 안된다
+static void PG_lcd_emu_address_changed(struct PG_lcd_t *lcd)
+{
+    uint64_t now = lcd->emu_now_ns;
+    if(lcd->emu_val_e) {
+        PG_lcd_emu_violation(lcd, PG_EMU_CHECK_AH, 0);
+    } else if(lcd->emu_fall_ns > 0 && now - lcd->emu_fall_ns < lcd->emu_timing.t_ah) {
+        PG_lcd_emu_violation(lcd, PG_EMU_CHECK_AH, now - lcd->emu_fall_ns);
+    }
+    lcd->emu_address_ns = now;
+}
+
+static void PG_lcd_emu_pin_apply(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    PG_lcd_emu_tick(lcd);
+    val = (val != 0);
+    uint64_t now = lcd->emu_now_ns;
+
+    if(pin == lcd->pin_e) {
+        PG_lcd_emu_set_e(lcd, val);
+        return;
+    }
+    if(pin == lcd->pin_rs || pin == lcd->pin_rw) {
+        uint8_t *addr = (pin == lcd->pin_rs) ? &lcd->emu_val_rs : &lcd->emu_val_rw;
+        if(*addr != val) {
+            *addr = val;
+            PG_lcd_emu_address_changed(lcd);
+        }
+        return;
+    }
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(pin == PG_lcd_chip_pin(lcd, chip)) {
+            if(lcd->emu_val_cs[chip] != val) {
+                lcd->emu_val_cs[chip] = val;
+                PG_lcd_emu_address_changed(lcd);
+            }
+            return;
+        }
+    }
+    // reset은 display off, start line 0
+    if(pin == lcd->pin_rst) {
+        lcd->emu_val_rst = val;
+        if(!val) {
+            for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+                lcd->emu_chip[chip].display_enable = false;
+                lcd->emu_chip[chip].start_line = 0;
+            }
+        }
+        return;
+    }
+
+    uint8_t data_pin_list[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_list);
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        if(data_pin_list[i] != pin) {
+            continue;
+        }
+        uint8_t data_bits = val ? (lcd->emu_val_data_bits | (1 << i)) : (lcd->emu_val_data_bits & ~(1 << i));
+        if(data_bits == lcd->emu_val_data_bits) {
+            return;
+        }
+        lcd->emu_val_data_bits = data_bits;
+        if(!lcd->emu_val_e && lcd->emu_fall_ns > 0 && now - lcd->emu_fall_ns < lcd->emu_timing.t_dhw) {
+            PG_lcd_emu_violation(lcd, PG_EMU_CHECK_DHW, now - lcd->emu_fall_ns);
+        }
+        lcd->emu_data_ns = now;
+        return;
+    }
+}
+
+// 기다리지 않고 emu 시간만 보낸다. 같은 bus의 panel은 시간도 같이 흐른다
+void PG_lcd_emu_delay_ns(struct PG_lcd_t *lcd, uint32_t nsec)
+{
+    if(lcd->bus == NULL) {
+        lcd->emu_now_ns += nsec;
+        return;
+    }
+    for(int i = 0 ; i < lcd->bus->panel_count ; ++i) {
+        lcd->bus->panel_list[i]->emu_now_ns += nsec;
+    }
+}
+
+// 같은 bus의 panel은 선을 공유한다
+void PG_lcd_emu_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    if(lcd->bus == NULL) {
+        PG_lcd_emu_pin_apply(lcd, pin, val);
+        return;
+    }
+    for(int i = 0 ; i < lcd->bus->panel_count ; ++i) {
+        PG_lcd_emu_pin_apply(lcd->bus->panel_list[i], pin, val);
+    }
+}
+static void PG_lcd_emu_pulse_e(struct PG_lcd_t *lcd, int val)
+{
+    PG_lcd_pin_set(lcd, lcd->pin_e, val);
+}
+void PG_lcd_emu_pulse(struct PG_lcd_t *lcd)
+{
+    PG_lcd_bus_delay_pulse(lcd, PG_lcd_emu_pulse_e);
+}
+// status read만 흉내낸다. display data read는 0
+int PG_lcd_emu_pin_get_val(struct PG_lcd_t *lcd, uint8_t pin)
+{
+    PG_lcd_emu_tick(lcd);
+    uint64_t now = lcd->emu_now_ns;
+    if(!lcd->emu_val_rw || !lcd->emu_val_e || lcd->emu_val_rs) {
+        return 0;
+    }
+    if(now - lcd->emu_rise_ns < lcd->emu_timing.t_ddr) {
+        PG_lcd_emu_violation(lcd, PG_EMU_CHECK_DDR, now - lcd->emu_rise_ns);
+    }
+    uint8_t status = 0;
+    for(int i = 0 ; i < lcd->chips ; ++i) {
+        const struct PG_emu_chip_t *chip = &lcd->emu_chip[i];
+        if(!lcd->emu_val_cs[i]) {
+            continue;
+        }
+        if(now < chip->busy_until_ns) {
+            status |= PG_STATUS_BUSY;
+        }
+        if(!chip->display_enable) {
+            status |= PG_STATUS_OFF;
+        }
+        if(!lcd->emu_val_rst) {
+            status |= PG_STATUS_RESET;
+        }
+    }
+    uint8_t data_pin_list[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_list);
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        if(data_pin_list[i] == pin) {
+            return (status >> i) & 1;
+        }
+    }
+    return 0;
+}
+int PG_lcd_emu_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
+{
+    UNUSED(pinmap_type);
+    if(PG_lcd_check_geometry(lcd) != 0) {
+        return 1;
+    }
+    PG_lcd_build_data_table(lcd, NULL);
+
+    PG_lcd_pin_all_low(lcd);
+    PG_lcd_reset(lcd);
+
+    PG_lcd_set_display_enable(lcd, 1);
+    PG_lcd_set_start_line(lcd, 0);
+    return 0;
+}
+int PG_lcd_emu_frame_end_callback(struct PG_lcd_t *lcd)
+{
+    lcd->emu_frame_ns = lcd->emu_now_ns - lcd->emu_frame_begin_ns;
+    lcd->emu_total_frame_ns += lcd->emu_frame_ns;
+    lcd->emu_frame_count++;
+    lcd->emu_frame_begin_ns = lcd->emu_now_ns;
+    return 0;
+}
+bool PG_lcd_emu_is_alive(struct PG_lcd_t *lcd)
+{
+    UNUSED(lcd);
+    return true;
+}
+
+void PG_lcd_emu_snapshot(const struct PG_lcd_t *lcd, struct PG_framebuffer_t *visible)
+{
+    PG_framebuffer_initialize(visible, lcd->columns);
+    for(int i = 0 ; i < lcd->chips ; ++i) {
+        const struct PG_emu_chip_t *chip = &lcd->emu_chip[i];
+        if(!chip->display_enable) {
+            continue;
+        }
+        for(int column = 0 ; column < PG_CHIP_COLUMNS ; ++column) {
+            uint64_t bits = 0;
+            for(int page = 0 ; page < PG_PAGES ; ++page) {
+                bits |= (uint64_t)chip->ram[page][column] << (page * 8);
+            }
+            // 화면 row y = RAM row (y + start_line)
+            int shift = chip->start_line;
+            if(shift != 0) {
+                bits = (bits >> shift) | (bits << (64 - shift));
+            }
+            PG_framebuffer_column_set(visible, i * PG_CHIP_COLUMNS + column, bits);
+        }
+    }
+}
+
+// glfw backend
+static void PG_lcd_glfw_pin_apply(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    struct pin_tuple_t {
+        uint8_t pin;
+        uint8_t* addr;
+    };
+    struct pin_tuple_t pin_tuple_list[] = {
+        { lcd->pin_rs, &lcd->glfw_val_rs },
+        { lcd->pin_e, &lcd->glfw_val_e },
+        { lcd->pin_cs1, &lcd->glfw_val_cs[0] },
+        { lcd->pin_cs2, &lcd->glfw_val_cs[1] },
+        { lcd->pin_cs3, &lcd->glfw_val_cs[2] },
+        { lcd->pin_cs4, &lcd->glfw_val_cs[3] },
+        { lcd->pin_rst, &lcd->glfw_val_rst },
+        { lcd->pin_led, &lcd->glfw_val_led },
+    };
+    int count = sizeof(pin_tuple_list) / sizeof(pin_tuple_list[0]);
+    for(int i = 0 ; i < count ; ++i) {
+        if(pin_tuple_list[i].pin == pin) {
+            *pin_tuple_list[i].addr = val;
+            return;
+        }
+    }
+
+    // data bits는 별도 처리
+    uint8_t data_pin_list[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_list);
+    for(int i = 0 ; i < 8 ; ++i) {
+        if(data_pin_list[i] == pin) {
+            uint8_t base_mask = 1 << i;
+            if(val) {
+                lcd->glfw_val_data_bits |= base_mask;
+            } else {
+                lcd->glfw_val_data_bits &= ~base_mask;
+            }
+        }
+    }
+}
+
+// 같은 bus의 panel은 선을 공유하므로 모두에게 같은 값이 보인다
+void PG_lcd_glfw_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    if(lcd->bus == NULL) {
+        PG_lcd_glfw_pin_apply(lcd, pin, val);
+        return;
+    }
+    for(int i = 0 ; i < lcd->bus->panel_count ; ++i) {
+        PG_lcd_glfw_pin_apply(lcd->bus->panel_list[i], pin, val);
+    }
+}
+
+void PG_lcd_glfw_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data)
+{
+    lcd->glfw_val_rs = rs;
+    lcd->glfw_val_data_bits = data;
+    if(lcd->bus == NULL) {
+        return;
+    }
+    for(int i = 0 ; i < lcd->bus->panel_count ; ++i) {
+        lcd->bus->panel_list[i]->glfw_val_rs = rs;
+        lcd->bus->panel_list[i]->glfw_val_data_bits = data;
+    }
+}
+
+// 선택된 chip 하나에 대해서 명령/데이터를 처리
+static void PG_lcd_glfw_exec(struct PG_lcd_t *lcd, int chip, int rs, uint8_t data_bits)
+{
+    if(rs == 0) {
+        int shift = 0;
+        // display on/off
+        shift = DATA_BITS_SET_DISPLAY_ENABLE;
+        if((data_bits >> shift) == (MASK_SET_DISPLAY_ENABLE >> shift)) {
+            lcd->glfw_state_display_enable = ((1 << shift) - 1) & data_bits;
+            //printf("display on/off : %d\n", glfw_state_display_enable);
+        }
+
+        // set column
+        shift = DATA_BITS_SET_COLUMN;
+        if((data_bits >> shift) == (MASK_SET_COLUMN >> shift)) {
+            lcd->glfw_state_column[chip] = ((1 << shift) - 1) & data_bits;
+            //printf("set column : %d\n", glfw_state_column);
+        }
+
+        // set page
+        shift = DATA_BITS_SET_PAGE;
+        if((data_bits >> shift) == (MASK_SET_PAGE >> shift)) {
+            lcd->glfw_state_page[chip] = ((1 << shift) - 1) & data_bits;
             //printf("set page : %d\n", glfw_state_page);
         }
 
@@ -371,10 +1116,108 @@ void PG_lcd_glfw_pulse(struct PG_lcd_t *lcd)
         // write display data
         //printf("write data\n");
         int chip_columns = (lcd->columns / lcd->chips);
-        int column = (lcd->glfw_state_chip * chip_columns) + lcd->glfw_state_column;
-        int idx = PG_BUFFER_INDEX(lcd->glfw_state_page, column);
+        int column = (chip * chip_columns) + lcd->glfw_state_column[chip];
+        int idx = PG_BUFFER_INDEX(lcd->glfw_state_page[chip], column);
         lcd->glfw_framebuffer.data[idx] = data_bits;
-        lcd->glfw_state_column = (lcd->glfw_state_column + 1) % chip_columns;
+        lcd->glfw_state_column[chip] = (lcd->glfw_state_column[chip] + 1) % chip_columns;
+    }
+}
+
+void PG_lcd_glfw_pulse(struct PG_lcd_t *lcd)
+{
+    /*
+    printf("RS  = %d\n", glfw_val_rs);
+    printf("E   = %d\n", glfw_val_e);
+    printf("D0  = %d\n", glfw_val_d0);
+    printf("D1  = %d\n", glfw_val_d1);
+    printf("D2  = %d\n", glfw_val_d2);
+    printf("D3  = %d\n", glfw_val_d3);
+    printf("D4  = %d\n", glfw_val_d4);
+    printf("D5  = %d\n", glfw_val_d5);
+    printf("D6  = %d\n", glfw_val_d6);
+    printf("D7  = %d\n", glfw_val_d7);
+    printf("CS1 = %d\n", glfw_val_cs[0]);
+    printf("CS2 = %d\n", glfw_val_cs[1]);
+    printf("RST = %d\n", glfw_val_rst);
+    printf("LED = %d\n", glfw_val_led);
+    */
+
+    // CS가 켜진 chip은 모두 같은 명령을 받는다
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(lcd->glfw_val_cs[chip] == 1) {
+            PG_lcd_glfw_exec(lcd, chip, lcd->glfw_val_rs, lcd->glfw_val_data_bits);
+        }
+    }
+    // 같은 bus의 다른 panel도 CS가 켜져 있으면 같은 값을 받는다
+    if(lcd->bus == NULL) {
+        return;
+    }
+    for(int i = 0 ; i < lcd->bus->panel_count ; ++i) {
+        struct PG_lcd_t *panel = lcd->bus->panel_list[i];
+        if(panel == lcd) {
+            continue;
+        }
+        for(int chip = 0 ; chip < panel->chips ; ++chip) {
+            if(panel->glfw_val_cs[chip] == 1) {
+                PG_lcd_glfw_exec(panel, chip, panel->glfw_val_rs, panel->glfw_val_data_bits);
+            }
+        }
+    }
+}
+
+// byte level 명령은 CS pin을 거치지 않으므로 mirror panel에도 직접 전한다
+void PG_lcd_glfw_write_command(struct PG_lcd_t *lcd, int chip, uint8_t cmd)
+{
+    if(chip == PG_CHIP_ALL) {
+        for(int i = 0 ; i < lcd->chips ; ++i) {
+            PG_lcd_glfw_write_command(lcd, i, cmd);
+        }
+        return;
+    }
+    PG_lcd_glfw_exec(lcd, chip, 0, cmd);
+    for(int i = 0 ; i < lcd->mirror_count ; ++i) {
+        PG_lcd_glfw_exec(lcd->mirror_list[i], chip, 0, cmd);
+    }
+}
+
+static void PG_lcd_glfw_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length)
+{
+    int chip_columns = (lcd->columns / lcd->chips);
+    lcd->glfw_state_page[chip] = page;
+    lcd->glfw_state_column[chip] = column;
+
+    // column이 끝까지 가면 0으로 돌아간다
+    while(length > 0) {
+        int count = chip_columns - lcd->glfw_state_column[chip];
+        if(count > length) {
+            count = length;
+        }
+        int idx = PG_BUFFER_INDEX(page, chip * chip_columns + lcd->glfw_state_column[chip]);
+        memcpy(&lcd->glfw_framebuffer.data[idx], data, count);
+        lcd->glfw_state_column[chip] = (lcd->glfw_state_column[chip] + count) % chip_columns;
+        data += count;
+        length -= count;
+    }
+}
+
+void PG_lcd_glfw_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length)
+{
+    if(chip == PG_CHIP_ALL) {
+        for(int i = 0 ; i < lcd->chips ; ++i) {
+            PG_lcd_glfw_write_data_run(lcd, i, page, column, data, length);
+        }
+        return;
+    }
+    PG_lcd_glfw_run(lcd, chip, page, column, data, length);
+    for(int i = 0 ; i < lcd->mirror_count ; ++i) {
+        PG_lcd_glfw_run(lcd->mirror_list[i], chip, page, column, data, length);
+    }
+}
+
+void PG_lcd_glfw_chip_broadcast(struct PG_lcd_t *lcd, uint8_t cmd)
+{
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        PG_lcd_glfw_write_command(lcd, chip, cmd);
     }
 }
 
@@ -399,6 +1242,11 @@ int PG_lcd_glfw_window_height(struct PG_lcd_t *lcd)
 int PG_lcd_glfw_setup(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type)
 {
     UNUSED(pinmap_type);
+    if(PG_lcd_check_geometry(lcd) != 0) {
+        return 1;
+    }
+
+    PG_lcd_build_data_table(lcd, NULL);
 
     PG_lcd_pin_all_low(lcd);
     PG_lcd_reset(lcd);
@@ -460,7 +1308,7 @@ int PG_lcd_glfw_frame_end_callback(struct PG_lcd_t *lcd)
                     continue;
                 }
                 int x = column;
-                int y = page * 8 + i;
+                int y = (page * 8 + i + lcd->rows - lcd->glfw_state_start_line) % lcd->rows;
 
                 int l = GLFW_LCD_BASE_X + x * (GLFW_LCD_PIXEL_SIZE + GLFW_LCD_PADDING);
                 int t = GLFW_LCD_BASE_Y + y * (GLFW_LCD_PIXEL_SIZE + GLFW_LCD_PADDING);
@@ -481,7 +1329,7 @@ int PG_lcd_glfw_frame_end_callback(struct PG_lcd_t *lcd)
     
     // grid for debugging
     glBegin(GL_LINES);
-    for(int column = 0 ; column < PG_COLUMNS - 1 ; ++column) {
+    for(int column = 0 ; column < lcd->columns - 1 ; ++column) {
         if(column % 8 != 0) {
             continue;
         }
@@ -491,7 +1339,7 @@ int PG_lcd_glfw_frame_end_callback(struct PG_lcd_t *lcd)
     }
     
     // row line
-    for(int row = 0 ; row < PG_ROWS - 1 ; ++row) {
+    for(int row = 0 ; row < lcd->rows - 1 ; ++row) {
         if(row % 8 != 0) {
             continue;
         }
@@ -502,13 +1350,18 @@ int PG_lcd_glfw_frame_end_callback(struct PG_lcd_t *lcd)
     glEnd();
 
     glfwSwapBuffers(lcd->glfw_window);
-    glfwPollEvents();
+    // async일때 event는 main thread의 is_alive에서 처리한다
+    if(!lcd->async_running) {
+        glfwPollEvents();
+    }
 
     return 0;
 }
 bool PG_lcd_glfw_is_alive(struct PG_lcd_t *lcd)
 {
-    UNUSED(lcd);
+    if(lcd->async_running) {
+        glfwPollEvents();
+    }
     if(glfwWindowShouldClose(lcd->glfw_window)) {
         return false;
     } else {
@@ -516,10 +1369,14 @@ bool PG_lcd_glfw_is_alive(struct PG_lcd_t *lcd)
     }
 }
 
-void PG_lcd_fill_all_pin(struct PG_lcd_t *lcd, uint8_t pin_table[PIN_COUNT])
+// PG_PIN_NONE인 optional pin은 빼고 채운다
+int PG_lcd_fill_all_pin(struct PG_lcd_t *lcd, uint8_t pin_table[PIN_COUNT])
 {
     int i = 0 ;
     *(pin_table + i++) = lcd->pin_rs;
+    if(lcd->pin_rw != PG_PIN_NONE) {
+        *(pin_table + i++) = lcd->pin_rw;
+    }
     *(pin_table + i++) = lcd->pin_e;
     *(pin_table + i++) = lcd->pin_d0;
     *(pin_table + i++) = lcd->pin_d1;
@@ -529,10 +1386,15 @@ void PG_lcd_fill_all_pin(struct PG_lcd_t *lcd, uint8_t pin_table[PIN_COUNT])
     *(pin_table + i++) = lcd->pin_d5;
     *(pin_table + i++) = lcd->pin_d6;
     *(pin_table + i++) = lcd->pin_d7;
-    *(pin_table + i++) = lcd->pin_cs1;
-    *(pin_table + i++) = lcd->pin_cs2;
+    for(int chip = 0 ; chip < PG_MAX_CHIPS ; ++chip) {
+        uint8_t pin = PG_lcd_chip_pin(lcd, chip);
+        if(pin != PG_PIN_NONE) {
+            *(pin_table + i++) = pin;
+        }
+    }
     *(pin_table + i++) = lcd->pin_rst;
     *(pin_table + i++) = lcd->pin_led;
+    return i;
 }
 void PG_lcd_fill_data_pin(struct PG_lcd_t *lcd, uint8_t pin_table[DATA_PIN_COUNT])
 {
@@ -547,35 +1409,73 @@ void PG_lcd_fill_data_pin(struct PG_lcd_t *lcd, uint8_t pin_table[DATA_PIN_COUNT
     *(pin_table + i++) = lcd->pin_d7;
 }
 
+// line_mask : data bit i를 움직이는 backend line. NULL이면 bit 그대로 쓴다
+void PG_lcd_build_data_table(struct PG_lcd_t *lcd, const uint32_t line_mask[DATA_PIN_COUNT])
+{
+    struct PG_data_table_t *table = &lcd->data_table;
+    uint8_t data_pin_table[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_table);
+
+    uint32_t all_mask = 0;
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        all_mask |= line_mask ? line_mask[i] : (1u << i);
+    }
+
+    for(int data = 0 ; data < 256 ; ++data) {
+        uint32_t set_mask = 0;
+        int count = 0;
+        for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+            if(!(data & (1 << i))) {
+                continue;
+            }
+            set_mask |= line_mask ? line_mask[i] : (1u << i);
+            table->pin_list[data][count++] = data_pin_table[i];
+        }
+        table->set_mask[data] = set_mask;
+        table->clr_mask[data] = all_mask & ~set_mask;
+        table->pin_count[data] = count;
+    }
+}
+
 void PG_lcd_reset(struct PG_lcd_t *lcd)
 {
     PG_lcd_pin_off(lcd, lcd->pin_rst);
-    PG_nanosleep(1);
+    PG_lcd_delay(lcd, lcd->timing.t_rst);
     PG_lcd_pin_on(lcd, lcd->pin_rst);
+    PG_lcd_model_invalidate(lcd);
 }
 
 void PG_lcd_initialize(struct PG_lcd_t *lcd, PG_backend_t backend_type)
 {
     memset(lcd, 0, sizeof(*lcd));
     lcd->backend = backend_type;
+    lcd->lines = &lcd->lines_storage;
     // set default value
     lcd->rows = PG_ROWS;
-    lcd->columns = PG_COLUMNS;
     lcd->pages = PG_PAGES;
-    lcd->chips = PG_CHIPS;
+    PG_lcd_set_geometry(lcd, PG_DEFAULT_CHIPS);
+    lcd->pin_rw = PG_PIN_NONE;
+    lcd->pin_cs3 = PG_PIN_NONE;
+    lcd->pin_cs4 = PG_PIN_NONE;
 
     // for backend
     switch(backend_type) {
         case PG_BACKEND_GPIO:
             lcd->pin_set_val = PG_lcd_gpio_pin_set_val;
             lcd->pulse = PG_lcd_gpio_pulse;
+            lcd->pin_get_val = PG_lcd_gpio_pin_get_val;
+            lcd->set_data_direction = PG_lcd_gpio_set_data_direction;
             lcd->setup = PG_lcd_gpio_setup;
             lcd->frame_end_callback = PG_lcd_gpio_frame_end_callback;
             lcd->is_alive = PG_lcd_gpio_is_alive;
             break;
         case PG_BACKEND_GLFW:
             lcd->pin_set_val = PG_lcd_glfw_pin_set_val;
+            lcd->write_bus = PG_lcd_glfw_write_bus;
             lcd->pulse = PG_lcd_glfw_pulse;
+            lcd->write_command = PG_lcd_glfw_write_command;
+            lcd->write_data_run = PG_lcd_glfw_write_data_run;
+            lcd->chip_broadcast = PG_lcd_glfw_chip_broadcast;
             lcd->setup = PG_lcd_glfw_setup;
             lcd->frame_end_callback = PG_lcd_glfw_frame_end_callback;
             lcd->is_alive = PG_lcd_glfw_is_alive;
@@ -583,382 +1483,2974 @@ void PG_lcd_initialize(struct PG_lcd_t *lcd, PG_backend_t backend_type)
         case PG_BACKEND_DUMMY:
             lcd->pin_set_val = PG_lcd_dummy_pin_set_val;
             lcd->pulse = PG_lcd_dummy_pulse;
+            lcd->pin_get_val = PG_lcd_dummy_pin_get_val;
             lcd->setup = PG_lcd_dummy_setup;
             lcd->frame_end_callback = PG_lcd_dummy_frame_end_callback;
             lcd->is_alive = PG_lcd_dummy_is_alive;
             break;
+        case PG_BACKEND_GPIOMEM:
+            lcd->pin_set_val = PG_lcd_gpiomem_pin_set_val;
+            lcd->write_bus = PG_lcd_gpiomem_write_bus;
+            lcd->pulse = PG_lcd_gpiomem_pulse;
+            lcd->pin_get_val = PG_lcd_gpiomem_pin_get_val;
+            lcd->set_data_direction = PG_lcd_gpiomem_set_data_direction;
+            lcd->write_data_run = PG_lcd_gpiomem_write_data_run;
+            lcd->setup = PG_lcd_gpiomem_setup;
+            lcd->frame_end_callback = PG_lcd_gpiomem_frame_end_callback;
+            lcd->is_alive = PG_lcd_gpiomem_is_alive;
+            lcd->gpiomem_fd = -1;
+            break;
+        case PG_BACKEND_EMU:
+            lcd->pin_set_val = PG_lcd_emu_pin_set_val;
+            lcd->pulse = PG_lcd_emu_pulse;
+            lcd->pin_get_val = PG_lcd_emu_pin_get_val;
+            lcd->delay_ns = PG_lcd_emu_delay_ns;
+            lcd->setup = PG_lcd_emu_setup;
+            lcd->frame_end_callback = PG_lcd_emu_frame_end_callback;
+            lcd->is_alive = PG_lcd_emu_is_alive;
+            lcd->emu_pin_write_ns = EMU_DEFAULT_PIN_WRITE_NS;
+            break;
         default:
             assert(!"invalid backend type");
             break;
     }
 
-    fps_counter_initialize(&g_fps_counter);
+    // KS0108 datasheet
+    lcd->timing.t_as = 140;
+    lcd->timing.t_pwh = 450;
+    lcd->timing.t_pwl = 450;
+    lcd->timing.t_dsw = 200;
+    lcd->timing.t_rst = 1000;
+    lcd->timing.t_ddr = 320;
+    lcd->timing.t_busy = 1000;
+    lcd->timing.t_busy_timeout = 1000 * 1000;
+    lcd->timing.t_ah = 10;
+    lcd->timing.t_dhw = 10;
+    // emu backend는 driver가 쓰는 값과 상관없이 datasheet 값으로 검사한다
+    lcd->emu_timing = lcd->timing;
+    if(!g_spin_calibration.calibrated) {
+        PG_timing_calibrate();
+    }
+
+    // frame pacer
+    PG_lcd_set_target_fps(lcd, PACER_DEFAULT_FPS);
+    lcd->pacer.policy = PG_PACER_SKIP;
+    lcd->pacer.max_catch_up = PACER_DEFAULT_MAX_CATCH_UP;
+
+    // planner cost model
+    lcd->bus_cost.command = 1;
+    lcd->bus_cost.data = 1;
+    lcd->bus_cost.chip_select = 1;
+
+    PG_lcd_shadow_invalidate(lcd);
+    PG_lcd_model_invalidate(lcd);
 }
 
-void PG_lcd_destroy(struct PG_lcd_t *lcd)
+void PG_lcd_set_geometry(struct PG_lcd_t *lcd, int chips)
 {
-    if(lcd->glfw_window != NULL) {
-        glfwDestroyWindow(lcd->glfw_window);
-        glfwTerminate();
+    assert(chips >= 1 && chips <= PG_MAX_CHIPS);
+    lcd->chips = chips;
+    lcd->columns = chips * PG_CHIP_COLUMNS;
+}
+
+// 쓰지 않는 chip의 CS는 비워둔다
+void PG_lcd_set_default_pins(struct PG_lcd_t *lcd)
+{
+    lcd->pin_rs = 24;
+    lcd->pin_e = 26;
+    lcd->pin_d0 = 3;
+    lcd->pin_d1 = 5;
+    lcd->pin_d2 = 7;
+    lcd->pin_d3 = 11;
+    lcd->pin_d4 = 13;
+    lcd->pin_d5 = 15;
+    lcd->pin_d6 = 19;
+    lcd->pin_d7 = 21;
+    lcd->pin_cs1 = 16;
+    lcd->pin_cs2 = 18;
+    lcd->pin_cs3 = (lcd->chips >= 3) ? 22 : PG_PIN_NONE;
+    lcd->pin_cs4 = (lcd->chips >= 4) ? 23 : PG_PIN_NONE;
+    lcd->pin_rst = 8;
+    lcd->pin_led = 12;
+}
+
+const char *PG_backend_name(PG_backend_t backend)
+{
+    const char *name_list[PG_BACKEND_MAX_COUNT] = {
+        "gpio", "glfw", "dummy", "gpiomem", "emu",
+    };
+    assert(backend >= 0 && backend < PG_BACKEND_MAX_COUNT);
+    return name_list[backend];
+}
+
+// 쓰는 chip마다 CS pin이 있어야 한다
+int PG_lcd_check_geometry(struct PG_lcd_t *lcd)
+{
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        if(PG_lcd_chip_pin(lcd, chip) == PG_PIN_NONE) {
+            fprintf(stderr, "chip %d has no CS pin\n", chip + 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uint8_t PG_lcd_chip_pin(struct PG_lcd_t *lcd, int chip)
+{
+    const uint8_t pin_list[PG_MAX_CHIPS] = {
+        lcd->pin_cs1, lcd->pin_cs2, lcd->pin_cs3, lcd->pin_cs4,
+    };
+    return pin_list[chip];
+}
+
+void PG_lcd_model_invalidate(struct PG_lcd_t *lcd)
+{
+    memset(lcd->chip_page, -1, sizeof(lcd->chip_page));
+    memset(lcd->chip_column, -1, sizeof(lcd->chip_column));
+    lcd->selected_chip = -1;
+}
+
+void PG_lcd_shadow_invalidate(struct PG_lcd_t *lcd)
+{
+    memset(lcd->lines->pin_shadow, -1, sizeof(lcd->lines->pin_shadow));
+    lcd->lines->data_valid = false;
+}
+
+void PG_lcd_destroy(struct PG_lcd_t *lcd)
+{
+    PG_lcd_stop_async(lcd);
+    if(lcd->glfw_window != NULL) {
+        glfwDestroyWindow(lcd->glfw_window);
+        glfwTerminate();
         lcd->glfw_window = NULL;
     }
+    if(lcd->backend == PG_BACKEND_GPIOMEM) {
+        PG_lcd_gpiomem_destroy(lcd);
+    }
 }
 
+// shadow와 상관없이 모든 pin을 쓰고 shadow를 low로 맞춘다
 void PG_lcd_pin_all_low(struct PG_lcd_t *lcd)
 {
     uint8_t pin_array[PIN_COUNT];
-    PG_lcd_fill_all_pin(lcd, pin_array);
-    for(int i = 0 ; i < PIN_COUNT ; ++i) {
+    int pin_count = PG_lcd_fill_all_pin(lcd, pin_array);
+    for(int i = 0 ; i < pin_count ; ++i) {
         uint8_t pin = pin_array[i];
-        PG_lcd_pin_off(lcd, pin);
+        lcd->pin_set_val(lcd, pin, 0);
+        lcd->lines->pin_shadow[pin] = 0;
     }
+    lcd->lines->data = 0;
+    lcd->lines->data_valid = true;
+}
+
+void PG_lcd_pin_set(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    val = (val != 0);
+    if(lcd->lines->pin_shadow[pin] == val) {
+        lcd->lines->counters.pin_writes_elided++;
+        return;
+    }
+    lcd->lines->pin_shadow[pin] = val;
+    lcd->pin_set_val(lcd, pin, val);
+    lcd->lines->counters.pin_writes++;
 }
 
 void PG_lcd_pin_on(struct PG_lcd_t *lcd, uint8_t pin)
 {
-    lcd->pin_set_val(lcd, pin, 1);
+    PG_lcd_pin_set(lcd, pin, 1);
 }
 
 void PG_lcd_pin_off(struct PG_lcd_t *lcd, uint8_t pin)
 {
-    lcd->pin_set_val(lcd, pin, 0);
+    PG_lcd_pin_set(lcd, pin, 0);
 }
 
+// 선택된 chip에 보낸다
 void PG_lcd_set_page(struct PG_lcd_t *lcd, int page)
 {
     uint8_t data = MASK_SET_PAGE | page;
-    PG_lcd_write_data_bit(lcd, data);
-    lcd->pulse(lcd);
+    PG_lcd_bus_write_command(lcd, lcd->selected_chip, data);
 }
 
 void PG_lcd_set_display_enable(struct PG_lcd_t *lcd, int val)
 {
     val = val & ((1 << DATA_BITS_SET_DISPLAY_ENABLE) - 1);
-    PG_lcd_pin_on(lcd, lcd->pin_cs1);
-    PG_lcd_pin_on(lcd, lcd->pin_cs2);
 
     // 0 0 1 1 1 1 1 ?
     uint8_t data = MASK_SET_DISPLAY_ENABLE;
     if(val) {
         data |= 1;
     }
-
-    PG_lcd_write_data_bit(lcd, data);
-    lcd->pulse(lcd);
-
-    PG_lcd_unselect_chip(lcd);
+    PG_lcd_bus_chip_broadcast(lcd, data);
 }
 
 void PG_lcd_set_start_line(struct PG_lcd_t *lcd, int idx)
 {
     idx = idx & ((1 << DATA_BITS_SET_START_LINE) - 1);
-
-    PG_lcd_pin_on(lcd, lcd->pin_cs1);
-    PG_lcd_pin_on(lcd, lcd->pin_cs2);
+    // 화면에 보이는 내용이 바뀌므로 dirty 기준을 버린다
+    if(lcd->start_line != idx) {
+        lcd->dirty_source = NULL;
+    }
+    lcd->start_line = idx;
 
     // 1 1 ? ?  ? ? ? ?
     uint8_t data = MASK_SET_START_LINE | idx;
-    PG_lcd_write_data_bit(lcd, data);
+    PG_lcd_bus_chip_broadcast(lcd, data);
+}
+
+void PG_lcd_set_column(struct PG_lcd_t *lcd, int column)
+{
+    column = column & ((1 << DATA_BITS_SET_COLUMN) - 1);
+
+    // 0 1 ? ? ? ? ? ?
+    uint8_t data = MASK_SET_COLUMN | column;
+    PG_lcd_bus_write_command(lcd, lcd->selected_chip, data);
+}
+
+// 다른 chip은 내린다. 같은 chip을 연속으로 선택하면 shadow가 걸러준다
+// mirror panel도 같은 chip을 선택한다. PG_CHIP_ALL이면 모두 켠다
+void PG_lcd_select_chip(struct PG_lcd_t *lcd, int chip)
+{
+    assert(chip == PG_CHIP_ALL || (chip >= 0 && chip < lcd->chips));
+    for(int i = 0 ; i < lcd->chips ; ++i) {
+        PG_lcd_pin_set(lcd, PG_lcd_chip_pin(lcd, i), chip == PG_CHIP_ALL || i == chip);
+    }
+    for(int m = 0 ; m < lcd->mirror_count ; ++m) {
+        struct PG_lcd_t *mirror = lcd->mirror_list[m];
+        for(int i = 0 ; i < mirror->chips ; ++i) {
+            PG_lcd_pin_set(mirror, PG_lcd_chip_pin(mirror, i), chip == PG_CHIP_ALL || i == chip);
+        }
+    }
+    lcd->selected_chip = chip;
+}
+
+void PG_lcd_unselect_chip(struct PG_lcd_t *lcd)
+{
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        PG_lcd_pin_off(lcd, PG_lcd_chip_pin(lcd, chip));
+    }
+    for(int m = 0 ; m < lcd->mirror_count ; ++m) {
+        struct PG_lcd_t *mirror = lcd->mirror_list[m];
+        for(int chip = 0 ; chip < mirror->chips ; ++chip) {
+            PG_lcd_pin_off(mirror, PG_lcd_chip_pin(mirror, chip));
+        }
+    }
+    lcd->selected_chip = -1;
+}
+
+void PG_lcd_write_data_bit(struct PG_lcd_t *lcd, uint8_t data)
+{
+    // 바뀐 bit 중에서 1이 될 pin 목록, 0이 될 pin 목록만 쓴다
+    const struct PG_data_table_t *table = &lcd->data_table;
+    uint8_t changed = lcd->lines->data_valid ? (lcd->lines->data ^ data) : 0xFF;
+    uint8_t on_bits = changed & data;
+    uint8_t off_bits = changed & ~data;
+
+    const uint8_t *on_list = table->pin_list[on_bits];
+    for(int i = 0 ; i < table->pin_count[on_bits] ; ++i) {
+        lcd->pin_set_val(lcd, on_list[i], 1);
+    }
+    const uint8_t *off_list = table->pin_list[off_bits];
+    for(int i = 0 ; i < table->pin_count[off_bits] ; ++i) {
+        lcd->pin_set_val(lcd, off_list[i], 0);
+    }
+    lcd->lines->counters.pin_writes += table->pin_count[changed];
+    lcd->lines->counters.pin_writes_elided += DATA_PIN_COUNT - table->pin_count[changed];
+
+    lcd->lines->data = data;
+    lcd->lines->data_valid = true;
+}
+
+// chip 하나 또는 PG_CHIP_ALL에 명령 하나. backend write_command가 있으면 그것을 쓴다
+void PG_lcd_bus_write_command(struct PG_lcd_t *lcd, int chip, uint8_t cmd)
+{
+    assert(chip == PG_CHIP_ALL || (chip >= 0 && chip < lcd->chips));
+    if(lcd->write_command != NULL) {
+        lcd->write_command(lcd, chip, cmd);
+        lcd->lines->counters.commands++;
+        lcd->lines->counters.pulses++;
+    } else {
+        if(lcd->selected_chip != chip) {
+            PG_lcd_select_chip(lcd, chip);
+        }
+        PG_lcd_write_bus(lcd, 0, cmd);
+        PG_lcd_pulse(lcd);
+    }
+    // page/column 명령이면 address model도 따라간다
+    int first = (chip == PG_CHIP_ALL) ? 0 : chip;
+    int last = (chip == PG_CHIP_ALL) ? lcd->chips : chip + 1;
+    for(int i = first ; i < last ; ++i) {
+        if((cmd >> DATA_BITS_SET_COLUMN) == (MASK_SET_COLUMN >> DATA_BITS_SET_COLUMN)) {
+            lcd->chip_column[i] = cmd & ((1 << DATA_BITS_SET_COLUMN) - 1);
+        } else if((cmd >> DATA_BITS_SET_PAGE) == (MASK_SET_PAGE >> DATA_BITS_SET_PAGE)) {
+            lcd->chip_page[i] = cmd & ((1 << DATA_BITS_SET_PAGE) - 1);
+        }
+    }
+}
+
+// chip을 선택하고 page/column 레지스터가 다를때만 명령을 보낸다
+// PG_CHIP_ALL이면 하나라도 다를때 모든 chip에 보낸다
+void PG_lcd_bus_address(struct PG_lcd_t *lcd, int chip, int page, int column)
+{
+    PG_lcd_select_chip(lcd, chip);
+    int first = (chip == PG_CHIP_ALL) ? 0 : chip;
+    int last = (chip == PG_CHIP_ALL) ? lcd->chips : chip + 1;
+    bool same_page = true;
+    bool same_column = true;
+    for(int i = first ; i < last ; ++i) {
+        same_page = same_page && lcd->chip_page[i] == page;
+        same_column = same_column && lcd->chip_column[i] == column;
+    }
+    if(!same_page) {
+        PG_lcd_set_page(lcd, page);
+    }
+    if(!same_column) {
+        PG_lcd_set_column(lcd, column);
+    }
+}
+
+void PG_lcd_bus_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length)
+{
+    if(lcd->write_data_run != NULL) {
+        lcd->write_data_run(lcd, chip, page, column, data, length);
+        lcd->lines->counters.bytes += length;
+        lcd->lines->counters.pulses += length;
+    } else {
+        PG_lcd_bus_address(lcd, chip, page, column);
+        for(int i = 0 ; i < length ; ++i) {
+            PG_lcd_write_bus(lcd, 1, data[i]);
+            PG_lcd_pulse(lcd);
+        }
+    }
+    // column 레지스터는 data를 쓸때마다 하나씩 증가하고 끝에서 0으로 돌아간다
+    int chip_columns = lcd->columns / lcd->chips;
+    int first = (chip == PG_CHIP_ALL) ? 0 : chip;
+    int last = (chip == PG_CHIP_ALL) ? lcd->chips : chip + 1;
+    for(int i = first ; i < last ; ++i) {
+        lcd->chip_page[i] = page;
+        lcd->chip_column[i] = (column + length) % chip_columns;
+    }
+}
+
+void PG_lcd_bus_chip_broadcast(struct PG_lcd_t *lcd, uint8_t cmd)
+{
+    if(lcd->chip_broadcast != NULL) {
+        lcd->chip_broadcast(lcd, cmd);
+        lcd->lines->counters.commands++;
+        lcd->lines->counters.pulses++;
+        return;
+    }
+    PG_lcd_bus_write_command(lcd, PG_CHIP_ALL, cmd);
+    PG_lcd_unselect_chip(lcd);
+}
+
+void PG_lcd_pulse(struct PG_lcd_t *lcd)
+{
     lcd->pulse(lcd);
+    lcd->lines->counters.pulses++;
+}
+
+bool PG_lcd_can_read_status(struct PG_lcd_t *lcd)
+{
+    return lcd->pin_rw != PG_PIN_NONE && lcd->pin_get_val != NULL;
+}
+
+// RS=0, RW=1 상태에서 E가 high인 동안 D0..D7에 status가 나온다
+uint8_t PG_lcd_read_status(struct PG_lcd_t *lcd, int chip)
+{
+    const struct PG_timing_t *timing = &lcd->timing;
+    PG_lcd_select_chip(lcd, chip);
+    if(lcd->set_data_direction != NULL) {
+        lcd->set_data_direction(lcd, 1);
+    }
+    PG_lcd_pin_set(lcd, lcd->pin_rs, 0);
+    PG_lcd_pin_set(lcd, lcd->pin_rw, 1);
+
+    PG_lcd_delay(lcd, timing->t_as);
+    PG_lcd_pin_set(lcd, lcd->pin_e, 1);
+    PG_lcd_delay(lcd, timing->t_ddr);
+
+    uint8_t data_pin_table[DATA_PIN_COUNT];
+    PG_lcd_fill_data_pin(lcd, data_pin_table);
+    uint8_t status = 0;
+    for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+        status |= (lcd->pin_get_val(lcd, data_pin_table[i]) & 1) << i;
+    }
+
+    PG_lcd_delay(lcd, timing->t_pwh > timing->t_ddr ? timing->t_pwh - timing->t_ddr : 0);
+    PG_lcd_pin_set(lcd, lcd->pin_e, 0);
+    PG_lcd_delay(lcd, timing->t_pwl);
+
+    PG_lcd_pin_set(lcd, lcd->pin_rw, 0);
+    if(lcd->set_data_direction != NULL) {
+        lcd->set_data_direction(lcd, 0);
+    }
+    // 입력으로 바꿨던 data pin의 출력 레벨은 믿을수 없다
+    lcd->lines->data_valid = false;
+    return status;
+}
+
+bool PG_lcd_wait_ready(struct PG_lcd_t *lcd, int chip)
+{
+    // status는 chip 하나씩만 읽을수 있다. 다 읽고 나면 다시 모두 선택한다
+    if(chip == PG_CHIP_ALL) {
+        bool ready = true;
+        for(int i = 0 ; i < lcd->chips ; ++i) {
+            ready = PG_lcd_wait_ready(lcd, i) && ready;
+        }
+        PG_lcd_select_chip(lcd, PG_CHIP_ALL);
+        return ready;
+    }
+    uint64_t deadline = 0;
+    for(;;) {
+        uint8_t status = PG_lcd_read_status(lcd, chip);
+        if(!(status & PG_STATUS_BUSY)) {
+            return true;
+        }
+        uint64_t now = PG_timing_now_ns();
+        if(deadline == 0) {
+            deadline = now + lcd->timing.t_busy_timeout;
+        } else if(now >= deadline) {
+            lcd->busy_timeout_count++;
+            return false;
+        }
+    }
+}
+
+// busy flag를 읽을수 있으면 선택된 chip이 ready가 된 다음에 bus를 바꾼다
+void PG_lcd_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data)
+{
+    rs = (rs != 0);
+    if(lcd->selected_chip != -1 && PG_lcd_can_read_status(lcd)) {
+        PG_lcd_wait_ready(lcd, lcd->selected_chip);
+    }
+    if(rs) {
+        lcd->lines->counters.bytes++;
+    } else {
+        lcd->lines->counters.commands++;
+    }
+    if(lcd->write_bus == NULL) {
+        PG_lcd_pin_set(lcd, lcd->pin_rs, rs);
+        PG_lcd_write_data_bit(lcd, data);
+        return;
+    }
+
+    bool same_data = lcd->lines->data_valid && lcd->lines->data == data;
+    if(same_data && lcd->lines->pin_shadow[lcd->pin_rs] == rs) {
+        lcd->lines->counters.pin_writes_elided += DATA_PIN_COUNT + 1;
+        return;
+    }
+    uint8_t changed = lcd->lines->data_valid ? (lcd->lines->data ^ data) : 0xFF;
+    lcd->lines->counters.pin_writes += lcd->data_table.pin_count[changed] + (lcd->lines->pin_shadow[lcd->pin_rs] != rs);
+    lcd->write_bus(lcd, rs, data);
+    lcd->lines->pin_shadow[lcd->pin_rs] = rs;
+    lcd->lines->data = data;
+    lcd->lines->data_valid = true;
+}
+
+// 절대 시간 deadline까지 잔다. 상대 시간으로 자면 오차가 frame마다 쌓인다
+static void PG_sleep_until_ns(uint64_t deadline_ns)
+{
+#ifdef __MACH__
+    uint64_t now = PG_timing_now_ns();
+    if(deadline_ns <= now) {
+        return;
+    }
+    struct timespec dt;
+    dt.tv_sec = (deadline_ns - now) / 1000000000ull;
+    dt.tv_nsec = (deadline_ns - now) % 1000000000ull;
+    nanosleep(&dt, NULL);
+#else
+    struct timespec deadline;
+    deadline.tv_sec = deadline_ns / 1000000000ull;
+    deadline.tv_nsec = deadline_ns % 1000000000ull;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+#endif
+}
+
+void PG_lcd_set_target_fps(struct PG_lcd_t *lcd, double fps)
+{
+    struct PG_pacer_t *pacer = &lcd->pacer;
+    if(fps <= 0) {
+        pacer->period_ns = 0;
+    } else {
+        pacer->period_ns = (uint64_t)(1000000000.0 / fps);
+    }
+    // 다음 frame부터 새 주기로 시작
+    pacer->started = false;
+}
+
+void PG_lcd_set_pacer_policy(struct PG_lcd_t *lcd, PG_pacer_policy_t policy)
+{
+    assert(policy < PG_PACER_POLICY_MAX_COUNT);
+    lcd->pacer.policy = policy;
+}
+
+void PG_lcd_render_begin(struct PG_lcd_t *lcd)
+{
+    PG_lcd_metrics_frame_begin(lcd);
+
+    struct PG_pacer_t *pacer = &lcd->pacer;
+    if(!pacer->started) {
+        pacer->deadline_ns = PG_timing_now_ns();
+        pacer->started = true;
+    }
+}
+
+// deadline은 frame마다 period씩 움직인다
+void PG_lcd_render_end(struct PG_lcd_t *lcd)
+{
+    PG_lcd_metrics_frame_work_done(lcd);
+
+    struct PG_pacer_t *pacer = &lcd->pacer;
+    pacer->frame_count++;
+
+    if(pacer->period_ns != 0) {
+        pacer->deadline_ns += pacer->period_ns;
+        uint64_t now = PG_timing_now_ns();
+        if(now > pacer->deadline_ns) {
+            uint64_t lateness = now - pacer->deadline_ns;
+            uint64_t missed = lateness / pacer->period_ns + 1;
+            pacer->deadline_miss_count++;
+            if(lateness > pacer->max_lateness_ns) {
+                pacer->max_lateness_ns = lateness;
+            }
+
+            // catch up은 max_catch_up 주기까지 따라잡고 그보다 많이 놓친 만큼만 버린다
+            uint64_t skip = missed;
+            if(pacer->policy == PG_PACER_CATCH_UP) {
+                skip = (missed > pacer->max_catch_up) ? missed - pacer->max_catch_up : 0;
+            }
+            pacer->deadline_ns += skip * pacer->period_ns;
+            pacer->skipped_deadline_count += skip;
+        }
+        PG_sleep_until_ns(pacer->deadline_ns);
+    }
+    PG_lcd_metrics_phase(lcd, PG_PHASE_SLEEP);
+}
+
+// render metrics
+// usec 값 -> histogram bucket. 2배 구간마다 bucket 4개 (오차 25% 이하)
+static int PG_metrics_bucket(uint64_t usec)
+{
+    if(usec < 4) {
+        return (int)usec;
+    }
+    int exponent = 63 - __builtin_clzll(usec);
+    int mantissa = (usec >> (exponent - 2)) & 0b11;
+    int bucket = 4 * (exponent - 1) + mantissa;
+    if(bucket >= PG_METRICS_HISTOGRAM_SIZE) {
+        bucket = PG_METRICS_HISTOGRAM_SIZE - 1;
+    }
+    return bucket;
+}
+
+// bucket의 상한 (usec)
+static uint64_t PG_metrics_bucket_upper(int bucket)
+{
+    if(bucket < 4) {
+        return bucket + 1;
+    }
+    int exponent = bucket / 4 + 1;
+    int mantissa = bucket % 4;
+    return (uint64_t)(5 + mantissa) << (exponent - 2);
+}
+
+static uint64_t PG_metrics_percentile(const struct PG_metrics_t *metrics, double ratio)
+{
+    if(metrics->frame_count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(metrics->frame_count * ratio);
+    if(target >= metrics->frame_count) {
+        target = metrics->frame_count - 1;
+    }
+    uint64_t seen = 0;
+    for(int bucket = 0 ; bucket < PG_METRICS_HISTOGRAM_SIZE ; ++bucket) {
+        seen += metrics->frame_time_histogram[bucket];
+        if(seen > target) {
+            uint64_t upper_ns = PG_metrics_bucket_upper(bucket) * 1000;
+            return upper_ns < metrics->frame_time_max_ns ? upper_ns : metrics->frame_time_max_ns;
+        }
+    }
+    return metrics->frame_time_max_ns;
+}
+
+void PG_lcd_metrics_frame_begin(struct PG_lcd_t *lcd)
+{
+    struct PG_metrics_t *metrics = &lcd->metrics;
+    uint64_t now = PG_timing_now_ns();
+    metrics->frame_begin_ns = now;
+    metrics->phase_mark_ns = now;
+    metrics->frame_begin_counters = lcd->lines->counters;
+    memset(metrics->last_phase_ns, 0, sizeof(metrics->last_phase_ns));
+}
+
+// 마지막 mark부터 지금까지를 phase 시간으로 센다
+void PG_lcd_metrics_phase(struct PG_lcd_t *lcd, PG_phase_t phase)
+{
+    struct PG_metrics_t *metrics = &lcd->metrics;
+    uint64_t now = PG_timing_now_ns();
+    uint64_t elapsed = now - metrics->phase_mark_ns;
+    metrics->last_phase_ns[phase] += elapsed;
+    metrics->phase_total_ns[phase] += elapsed;
+    metrics->phase_mark_ns = now;
+}
+
+void PG_lcd_metrics_frame_work_done(struct PG_lcd_t *lcd)
+{
+    struct PG_metrics_t *metrics = &lcd->metrics;
+    uint64_t now = PG_timing_now_ns();
+    uint64_t frame_time = now - metrics->frame_begin_ns;
+    metrics->phase_mark_ns = now;
+
+    metrics->frame_count++;
+    metrics->frame_time_histogram[PG_metrics_bucket(frame_time / 1000)]++;
+    metrics->frame_time_total_ns += frame_time;
+    if(frame_time > metrics->frame_time_max_ns) {
+        metrics->frame_time_max_ns = frame_time;
+    }
+
+    const struct PG_bus_counters_t *begin = &metrics->frame_begin_counters;
+    const struct PG_bus_counters_t *end = &lcd->lines->counters;
+    metrics->last_frame.bytes = end->bytes - begin->bytes;
+    metrics->last_frame.commands = end->commands - begin->commands;
+    metrics->last_frame.pulses = end->pulses - begin->pulses;
+    metrics->last_frame.pin_writes = end->pin_writes - begin->pin_writes;
+    metrics->last_frame.pin_writes_elided = end->pin_writes_elided - begin->pin_writes_elided;
+    metrics->last_frame.changed_bytes = end->changed_bytes - begin->changed_bytes;
+}
+
+void PG_lcd_get_metrics(const struct PG_lcd_t *lcd, struct PG_metrics_report_t *report)
+{
+    const struct PG_metrics_t *metrics = &lcd->metrics;
+    memset(report, 0, sizeof(*report));
+    report->frame_count = metrics->frame_count;
+    report->last_frame = metrics->last_frame;
+    report->total = lcd->lines->counters;
+    if(metrics->frame_count == 0) {
+        return;
+    }
+
+    double frame_count = (double)metrics->frame_count;
+    report->frame_time_p50_ns = PG_metrics_percentile(metrics, 0.50);
+    report->frame_time_p99_ns = PG_metrics_percentile(metrics, 0.99);
+    report->frame_time_max_ns = metrics->frame_time_max_ns;
+    report->frame_time_avg_ns = metrics->frame_time_total_ns / metrics->frame_count;
+
+    report->bytes_per_frame = lcd->lines->counters.bytes / frame_count;
+    report->commands_per_frame = lcd->lines->counters.commands / frame_count;
+    report->pulses_per_frame = lcd->lines->counters.pulses / frame_count;
+    report->pin_writes_per_frame = lcd->lines->counters.pin_writes / frame_count;
+    if(lcd->lines->counters.changed_bytes > 0) {
+        report->write_amplification = lcd->lines->counters.bytes / (double)lcd->lines->counters.changed_bytes;
+    }
+    for(int phase = 0 ; phase < PG_PHASE_MAX_COUNT ; ++phase) {
+        report->phase_avg_ns[phase] = metrics->phase_total_ns[phase] / metrics->frame_count;
+    }
+}
+
+// 카운터도 같이 0으로 돌려서 frame당 평균이 맞게 한다
+void PG_lcd_reset_metrics(struct PG_lcd_t *lcd)
+{
+    memset(&lcd->metrics, 0, sizeof(lcd->metrics));
+    memset(&lcd->lines->counters, 0, sizeof(lcd->lines->counters));
+}
 
+// lcd->buffer 전체를 보낸다. 밖에서 lcd->buffer를 고쳤을수 있으니 dirty 기준도 버린다
+void PG_lcd_commit_buffer(struct PG_lcd_t *lcd)
+{
+    PG_lcd_render_begin(lcd);
+    lcd->dirty_source = NULL;
+    const int chip_columns = lcd->columns / lcd->chips;
+    // 좌우가 같은 page는 먼저 한번에 보내고 나머지를 chip별로 보낸다
+    bool same_list[PG_PAGES];
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        int idx = PG_BUFFER_INDEX(page, 0);
+        same_list[page] = lcd->chips > 1;
+        for(int chip = 1 ; chip < lcd->chips && same_list[page] ; ++chip) {
+            same_list[page] = memcmp(&lcd->buffer.data[idx], &lcd->buffer.data[idx + chip * chip_columns], chip_columns) == 0;
+        }
+        if(same_list[page]) {
+            PG_lcd_bus_write_data_run(lcd, PG_CHIP_ALL, page, 0, &lcd->buffer.data[idx], chip_columns);
+        }
+    }
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        for(int page = 0 ; page < lcd->pages ; ++page) {
+            if(same_list[page]) {
+                continue;
+            }
+            int idx = PG_BUFFER_INDEX(page, chip * chip_columns);
+            PG_lcd_bus_write_data_run(lcd, chip, page, 0, &lcd->buffer.data[idx], chip_columns);
+        }
+    }
     PG_lcd_unselect_chip(lcd);
+    PG_lcd_metrics_phase(lcd, PG_PHASE_BUS);
+
+    lcd->frame_end_callback(lcd);
+    PG_lcd_metrics_phase(lcd, PG_PHASE_FRAME_END);
+    PG_lcd_render_end(lcd);
+}
+
+void PG_lcd_fill(struct PG_lcd_t *lcd, uint8_t pattern)
+{
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        memset(&lcd->buffer.data[PG_BUFFER_INDEX(page, 0)], pattern, lcd->columns);
+    }
+    // 모든 chip이 같은 내용이므로 commit이 page마다 한번씩만 보낸다
+    PG_lcd_commit_buffer(lcd);
+}
+
+// refresh planner
+// 바뀐 byte 구간 [begin, end)
+struct PG_refresh_span_t {
+    uint8_t begin;
+    uint8_t end;
+};
+// 바뀐 (chip, page) 하나. dirty_mask bit i = column i가 바뀜
+// chip이 PG_CHIP_ALL이면 모든 chip에 같은 byte를 쓴다
+struct PG_refresh_item_t {
+    int8_t chip;
+    uint8_t page;
+    uint64_t dirty_mask;
+    // span 사이 빈틈을 합칠때 다시 써도 되는 column
+    // PG_CHIP_ALL은 chip 0의 byte를 모든 chip에 쓰므로 chip마다 내용이 같은 column만 된다
+    uint64_t mergeable_mask;
+    uint8_t span_count;
+    struct PG_refresh_span_t span_list[PG_CHIP_COLUMNS / 2 + 1];
+};
+// 실제로 보낼 run 하나
+struct PG_refresh_run_t {
+    int8_t chip;
+    uint8_t page;
+    uint8_t column;
+    uint8_t length;
+};
+// planner가 흉내내는 controller 상태
+struct PG_refresh_model_t {
+    int selected_chip;
+    int chip_page[PG_MAX_CHIPS];
+    int chip_column[PG_MAX_CHIPS];
+};
+
+// 예전 render 방식 비용: page마다 chip 선택/해제 + page/column 0 설정.
+// 예전 loop는 set column을 보낸 column만 기억했기 때문에
+// 이어진 span 안에서도 한 byte 걸러 set column을 다시 보냈다.
+// column 0에서 시작하는 span은 첫 byte를 건너뛰므로 len / 2 번이다
+static uint32_t PG_refresh_naive_cost(struct PG_lcd_t *lcd, const struct PG_refresh_item_t *item)
+{
+    const struct PG_bus_cost_t *cost = &lcd->bus_cost;
+    uint32_t cycles = cost->chip_select * 2 + cost->command * 2;
+    for(int i = 0 ; i < item->span_count ; ++i) {
+        const struct PG_refresh_span_t *span = &item->span_list[i];
+        int len = span->end - span->begin;
+        int set_column_count = (span->begin == 0) ? len / 2 : (len + 1) / 2;
+        cycles += cost->command * set_column_count;
+    }
+    cycles += cost->data * __builtin_popcountll(item->dirty_mask);
+    return cycles;
+}
+
+// diff engine
+// (chip, page) 하나의 64 byte를 한번에 비교해서 바뀐 byte의 bitmap을 만든다
+#if defined(__SSE2__)
+static uint64_t PG_diff_chip_page(const uint8_t *prev, const uint8_t *next)
+{
+    uint64_t mask = 0;
+    for(int i = 0 ; i < PG_CHIP_COLUMNS ; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&prev[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&next[i]);
+        uint32_t same = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        mask |= (uint64_t)(~same & 0xFFFF) << i;
+    }
+    return mask;
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+static uint64_t PG_diff_chip_page(const uint8_t *prev, const uint8_t *next)
+{
+    // byte마다 자기 bit만 남기고 pairwise add로 16 byte -> 16 bit
+    static const uint8_t bit_weight[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128,
+        1, 2, 4, 8, 16, 32, 64, 128,
+    };
+    const uint8x16_t weight = vld1q_u8(bit_weight);
+    uint64_t mask = 0;
+    for(int i = 0 ; i < PG_CHIP_COLUMNS ; i += 16) {
+        uint8x16_t diff = vmvnq_u8(vceqq_u8(vld1q_u8(&prev[i]), vld1q_u8(&next[i])));
+        uint8x16_t bits = vandq_u8(diff, weight);
+        uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        uint64_t lane = vget_lane_u8(sum, 0) | ((uint64_t)vget_lane_u8(sum, 1) << 8);
+        mask |= lane << i;
+    }
+    return mask;
+}
+#else
+// 64bit word 하나의 byte별 0이 아닌지를 8bit로 모은다
+static uint64_t PG_diff_word_mask(uint64_t x)
+{
+    const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t high = (((x & low7) + low7) | x) & ~low7;
+    return ((high >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+static uint64_t PG_diff_chip_page(const uint8_t *prev, const uint8_t *next)
+{
+    uint64_t mask = 0;
+    for(int i = 0 ; i < PG_CHIP_COLUMNS ; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, &prev[i], sizeof(a));
+        memcpy(&b, &next[i], sizeof(b));
+        if(a != b) {
+            mask |= PG_diff_word_mask(a ^ b) << i;
+        }
+    }
+    return mask;
+}
+#endif
+
+// 1이 연속된 구간이 span
+static void PG_refresh_item_spans(struct PG_refresh_item_t *item)
+{
+    item->span_count = 0;
+    uint64_t rest = item->dirty_mask;
+    while(rest != 0) {
+        int begin = __builtin_ctzll(rest);
+        uint64_t clean = ~rest & (~0ULL << begin);
+        int end = (clean == 0) ? PG_CHIP_COLUMNS : __builtin_ctzll(clean);
+        rest = (end == PG_CHIP_COLUMNS) ? 0 : (rest & (~0ULL << end));
+
+        item->span_list[item->span_count].begin = begin;
+        item->span_list[item->span_count].end = end;
+        item->span_count++;
+    }
+}
+
+// (chip, page)에서 dirty_begin/end 안에 드는 column의 bitmap. 없으면 0
+static inline uint64_t PG_refresh_range_mask(const uint16_t *dirty_begin, const uint16_t *dirty_end, int chip, int page)
+{
+    int chip_begin = chip * PG_CHIP_COLUMNS;
+    int begin = dirty_begin[page] - chip_begin;
+    int end = dirty_end[page] - chip_begin;
+    if(begin < 0) { begin = 0; }
+    if(end > PG_CHIP_COLUMNS) { end = PG_CHIP_COLUMNS; }
+    if(begin >= end) {
+        return 0;
+    }
+    uint64_t range_mask = (end == PG_CHIP_COLUMNS) ? ~0ULL : ((1ULL << end) - 1);
+    return range_mask & (~0ULL << begin);
+}
+
+// 한번의 비교로 (chip, page)별 dirty bitmap과 span 목록을 만든다
+// dirty_begin/end 밖의 column은 비교하지 않는다
+// chips가 상수로 들어오면 chip loop가 펼쳐진다
+__attribute__((always_inline)) static inline int PG_refresh_collect_chips(const uint8_t *const *prev_list, int prev_count, const uint8_t *next, const uint16_t *dirty_begin, const uint16_t *dirty_end, struct PG_refresh_item_t *item_list, const int chips)
+{
+    int item_count = 0;
+    for(int chip = 0 ; chip < chips ; ++chip) {
+        int chip_begin = chip * PG_CHIP_COLUMNS;
+        for(int page = 0 ; page < PG_PAGES ; ++page) {
+            uint64_t range_mask = PG_refresh_range_mask(dirty_begin, dirty_end, chip, page);
+            if(range_mask == 0) {
+                continue;
+            }
+
+            int idx = PG_BUFFER_INDEX(page, chip_begin);
+            uint64_t dirty_mask = 0;
+            for(int i = 0 ; i < prev_count ; ++i) {
+                dirty_mask |= PG_diff_chip_page(&prev_list[i][idx], &next[idx]);
+            }
+            dirty_mask &= range_mask;
+            if(dirty_mask == 0) {
+                continue;
+            }
+            struct PG_refresh_item_t *item = &item_list[item_count++];
+            item->chip = chip;
+            item->page = page;
+            item->dirty_mask = dirty_mask;
+            item->mergeable_mask = ~0ULL;
+            PG_refresh_item_spans(item);
+        }
+    }
+    return item_count;
+}
+
+// 흔한 geometry(chip 1~3개)는 따로 펼친 버전을 쓴다
+// prev_list : mirror panel들의 현재 RAM. 어느 하나라도 다르면 보낸다
+static int PG_refresh_collect(struct PG_lcd_t *lcd, const uint8_t *const *prev_list, int prev_count, const uint8_t *next, const uint16_t *dirty_begin, const uint16_t *dirty_end, struct PG_refresh_item_t *item_list)
+{
+    assert(lcd->columns / lcd->chips == PG_CHIP_COLUMNS);
+    switch(lcd->chips) {
+        case 1:
+            return PG_refresh_collect_chips(prev_list, prev_count, next, dirty_begin, dirty_end, item_list, 1);
+        case 2:
+            return PG_refresh_collect_chips(prev_list, prev_count, next, dirty_begin, dirty_end, item_list, 2);
+        case 3:
+            return PG_refresh_collect_chips(prev_list, prev_count, next, dirty_begin, dirty_end, item_list, 3);
+        default:
+            return PG_refresh_collect_chips(prev_list, prev_count, next, dirty_begin, dirty_end, item_list, lcd->chips);
+    }
+}
+
+// 같은 page에서 두 chip 이상이 바뀌었고 바뀐 column의 내용이 chip마다 같으면
+// (지우기, 채우기, 반복 무늬) item을 PG_CHIP_ALL 하나로 합친다
+// 안바뀐 chip에도 같은 byte를 다시 쓰게 되지만 dirty 구간 안이면 이미 같은 값이다.
+// 구간 밖은 panel이 next와 다를 수 있고 lcd->buffer에도 반영되지 않으므로
+// 모든 chip의 dirty 구간이 바뀐 column을 덮을 때만 합친다
+static int PG_refresh_fold_broadcast(struct PG_lcd_t *lcd, const uint8_t *next, const uint16_t *dirty_begin, const uint16_t *dirty_end, struct PG_refresh_item_t *item_list, int item_count)
+{
+    if(lcd->chips < 2 || item_count < 2) {
+        return item_count;
+    }
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        uint64_t union_mask = 0;
+        int page_items = 0;
+        for(int i = 0 ; i < item_count ; ++i) {
+            if(item_list[i].page == page) {
+                union_mask |= item_list[i].dirty_mask;
+                page_items++;
+            }
+        }
+        if(page_items < 2) {
+            continue;
+        }
+        uint64_t range_mask = ~0ULL;
+        for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+            range_mask &= PG_refresh_range_mask(dirty_begin, dirty_end, chip, page);
+        }
+        if((union_mask & ~range_mask) != 0) {
+            continue;
+        }
+        int idx = PG_BUFFER_INDEX(page, 0);
+        uint64_t mismatch = 0;
+        for(int chip = 1 ; chip < lcd->chips ; ++chip) {
+            mismatch |= PG_diff_chip_page(&next[idx], &next[idx + chip * PG_CHIP_COLUMNS]);
+        }
+        if((mismatch & union_mask) != 0) {
+            continue;
+        }
+        // page의 item을 지우고 뒤에 broadcast item 하나를 붙인다
+        int keep = 0;
+        for(int i = 0 ; i < item_count ; ++i) {
+            if(item_list[i].page != page) {
+                item_list[keep++] = item_list[i];
+            }
+        }
+        struct PG_refresh_item_t *item = &item_list[keep];
+        item->chip = PG_CHIP_ALL;
+        item->page = page;
+        item->dirty_mask = union_mask;
+        item->mergeable_mask = ~mismatch & range_mask;
+        PG_refresh_item_spans(item);
+        item_count = keep + 1;
+    }
+    return item_count;
+}
+
+// 작은 빈틈은 column을 다시 지정하는 것보다 안바뀐 byte를 다시 쓰는게 싸다
+// 빈틈의 column이 모두 mergeable_mask에 있어야 한다
+static void PG_refresh_merge_spans(struct PG_lcd_t *lcd, struct PG_refresh_item_t *item)
+{
+    const struct PG_bus_cost_t *cost = &lcd->bus_cost;
+    int count = 0;
+    for(int i = 0 ; i < item->span_count ; ++i) {
+        struct PG_refresh_span_t *span = &item->span_list[i];
+        if(count > 0) {
+            struct PG_refresh_span_t *last = &item->span_list[count - 1];
+            int gap = span->begin - last->end;
+            uint64_t gap_mask = ((1ULL << gap) - 1) << last->end;
+            if(gap * cost->data <= cost->command && (gap_mask & ~item->mergeable_mask) == 0) {
+                last->end = span->end;
+                continue;
+            }
+        }
+        item->span_list[count++] = *span;
+    }
+    item->span_count = count;
+}
+
+// PG_CHIP_ALL이면 모든 chip의 레지스터가 같아야 명령을 생략할수 있다
+static bool PG_refresh_model_at(struct PG_lcd_t *lcd, const struct PG_refresh_model_t *model, int chip, int page, int column)
+{
+    int first = (chip == PG_CHIP_ALL) ? 0 : chip;
+    int last = (chip == PG_CHIP_ALL) ? lcd->chips : chip + 1;
+    bool same = true;
+    for(int i = first ; i < last ; ++i) {
+        if(page >= 0 && model->chip_page[i] != page) {
+            same = false;
+        }
+        if(column >= 0 && model->chip_column[i] != column) {
+            same = false;
+        }
+    }
+    return same;
+}
+
+static void PG_refresh_model_set(struct PG_lcd_t *lcd, struct PG_refresh_model_t *model, int chip, int page, int column)
+{
+    int first = (chip == PG_CHIP_ALL) ? 0 : chip;
+    int last = (chip == PG_CHIP_ALL) ? lcd->chips : chip + 1;
+    for(int i = first ; i < last ; ++i) {
+        model->chip_page[i] = page;
+        model->chip_column[i] = column;
+    }
+}
+
+// item을 처리하기 직전의 전환 비용 (chip 선택, page/column 설정)
+static uint32_t PG_refresh_enter_cost(struct PG_lcd_t *lcd, const struct PG_refresh_model_t *model, const struct PG_refresh_item_t *item)
+{
+    const struct PG_bus_cost_t *cost = &lcd->bus_cost;
+    uint32_t cycles = 0;
+    if(model->selected_chip != item->chip) {
+        cycles += cost->chip_select;
+    }
+    if(!PG_refresh_model_at(lcd, model, item->chip, item->page, -1)) {
+        cycles += cost->command;
+    }
+    if(!PG_refresh_model_at(lcd, model, item->chip, -1, item->span_list[0].begin)) {
+        cycles += cost->command;
+    }
+    return cycles;
+}
+
+// 전환 비용이 가장 싼 item부터 고르는 greedy 순서로 run 목록을 만든다
+static int PG_refresh_plan(struct PG_lcd_t *lcd, struct PG_refresh_item_t *item_list, int item_count, struct PG_refresh_run_t *run_list, uint32_t *planned_cycles)
+{
+    const struct PG_bus_cost_t *cost = &lcd->bus_cost;
+    int chip_columns = lcd->columns / lcd->chips;
+
+    struct PG_refresh_model_t model;
+    model.selected_chip = lcd->selected_chip;
+    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+        model.chip_page[chip] = lcd->chip_page[chip];
+        model.chip_column[chip] = lcd->chip_column[chip];
+    }
+
+    // item_count가 0이어도 VLA 길이는 1 이상
+    bool done_list[item_count + 1];
+    memset(done_list, 0, sizeof(done_list));
+
+    uint32_t cycles = 0;
+    int run_count = 0;
+    for(int step = 0 ; step < item_count ; ++step) {
+        int best = -1;
+        uint32_t best_cost = 0;
+        for(int i = 0 ; i < item_count ; ++i) {
+            if(done_list[i]) {
+                continue;
+            }
+            uint32_t enter_cost = PG_refresh_enter_cost(lcd, &model, &item_list[i]);
+            if(best < 0 || enter_cost < best_cost) {
+                best = i;
+                best_cost = enter_cost;
+            }
+        }
+        done_list[best] = true;
+
+        const struct PG_refresh_item_t *item = &item_list[best];
+        if(model.selected_chip != item->chip) {
+            cycles += cost->chip_select;
+            model.selected_chip = item->chip;
+        }
+        for(int i = 0 ; i < item->span_count ; ++i) {
+            const struct PG_refresh_span_t *span = &item->span_list[i];
+            if(!PG_refresh_model_at(lcd, &model, item->chip, item->page, -1)) {
+                cycles += cost->command;
+            }
+            if(!PG_refresh_model_at(lcd, &model, item->chip, -1, span->begin)) {
+                cycles += cost->command;
+            }
+            int length = span->end - span->begin;
+            cycles += cost->data * length;
+            PG_refresh_model_set(lcd, &model, item->chip, item->page, span->end % chip_columns);
+
+            struct PG_refresh_run_t *run = &run_list[run_count++];
+            run->chip = item->chip;
+            run->page = item->page;
+            run->column = span->begin;
+            run->length = length;
+        }
+    }
+    *planned_cycles = cycles;
+    return run_count;
+}
+
+__attribute__((always_inline)) static inline void PG_rotate_columns(const struct PG_framebuffer_t *src, struct PG_framebuffer_t *dst, int shift, const int columns)
+{
+    for(int column = 0 ; column < columns ; ++column) {
+        uint64_t bits = PG_framebuffer_column_get(src, column);
+        bits = (bits << shift) | (bits >> (64 - shift));
+        PG_framebuffer_column_set(dst, column, bits);
+    }
+}
+
+// 화면 기준 framebuffer를 RAM 배치로 옮긴다
+// column 하나를 64bit로 보면 start_line만큼 rotate하는 것과 같다
+static void PG_lcd_to_physical(struct PG_lcd_t *lcd, const struct PG_framebuffer_t *buffer, const uint16_t *dirty_begin, const uint16_t *dirty_end, struct PG_framebuffer_t *physical, uint16_t *physical_begin, uint16_t *physical_end)
+{
+    int shift = lcd->start_line;
+    if(lcd->columns == PG_DEFAULT_COLUMNS) {
+        PG_rotate_columns(buffer, physical, shift, PG_DEFAULT_COLUMNS);
+    } else {
+        PG_rotate_columns(buffer, physical, shift, lcd->columns);
+    }
+
+    // 화면 page 하나는 RAM page 두개에 걸친다
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        physical_begin[page] = lcd->columns;
+        physical_end[page] = 0;
+    }
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        if(dirty_begin[page] >= dirty_end[page]) {
+            continue;
+        }
+        int upper = ((page * 8 + shift) / 8) % lcd->pages;
+        int lower = ((page * 8 + shift + 7) / 8) % lcd->pages;
+        int targets[2] = { upper, lower };
+        for(int i = 0 ; i < 2 ; ++i) {
+            int target = targets[i];
+            if(dirty_begin[page] < physical_begin[target]) { physical_begin[target] = dirty_begin[page]; }
+            if(dirty_end[page] > physical_end[target]) { physical_end[target] = dirty_end[page]; }
+        }
+    }
+}
+
+// dirty_begin/end 구간만 비교해서 보내고 lcd->buffer에 반영한다
+// meter : phase 시간을 기록할 lcd (bus render면 첫번째 panel)
+static void PG_lcd_refresh(struct PG_lcd_t *lcd, struct PG_lcd_t *meter, struct PG_framebuffer_t *buffer, const uint16_t *dirty_begin, const uint16_t *dirty_end)
+{
+    // start line이 0이 아니면 RAM 배치로 돌린 사본과 비교한다
+    struct PG_framebuffer_t physical;
+    uint16_t physical_begin[PG_PAGES];
+    uint16_t physical_end[PG_PAGES];
+    if(lcd->start_line != 0) {
+        PG_lcd_to_physical(lcd, buffer, dirty_begin, dirty_end, &physical, physical_begin, physical_end);
+        buffer = &physical;
+        dirty_begin = physical_begin;
+        dirty_end = physical_end;
+    }
+
+    // diff가 존재하는 page/chip 찾아내기
+    // 해당 page/chip에서만 변경을 수행하면 명령을 줄일수 있다
+    const uint8_t *prev_list[1 + PG_BUS_MAX_PANELS];
+    int prev_count = 0;
+    prev_list[prev_count++] = lcd->buffer.data;
+    for(int i = 0 ; i < lcd->mirror_count ; ++i) {
+        prev_list[prev_count++] = lcd->mirror_list[i]->buffer.data;
+    }
+    const uint8_t *next = buffer->data;
+    struct PG_refresh_item_t item_list[lcd->pages * lcd->chips];
+    int item_count = PG_refresh_collect(lcd, prev_list, prev_count, next, dirty_begin, dirty_end, item_list);
+
+    uint32_t naive_cycles = 0;
+    uint32_t changed_bytes = 0;
+    for(int i = 0 ; i < item_count ; ++i) {
+        naive_cycles += PG_refresh_naive_cost(lcd, &item_list[i]);
+        changed_bytes += __builtin_popcountll(item_list[i].dirty_mask);
+    }
+    lcd->lines->counters.changed_bytes += changed_bytes;
+    item_count = PG_refresh_fold_broadcast(lcd, next, dirty_begin, dirty_end, item_list, item_count);
+    for(int i = 0 ; i < item_count ; ++i) {
+        PG_refresh_merge_spans(lcd, &item_list[i]);
+    }
+
+    struct PG_refresh_run_t run_list[lcd->pages * lcd->chips * (PG_CHIP_COLUMNS / 2 + 1)];
+    uint32_t planned_cycles = 0;
+    int run_count = PG_refresh_plan(lcd, item_list, item_count, run_list, &planned_cycles);
+    PG_lcd_metrics_phase(meter, PG_PHASE_DIFF);
+
+    int chip_columns = lcd->columns / lcd->chips;
+    for(int i = 0 ; i < run_count ; ++i) {
+        const struct PG_refresh_run_t *run = &run_list[i];
+        int chip_begin = (run->chip == PG_CHIP_ALL) ? 0 : run->chip * chip_columns;
+        int idx = PG_BUFFER_INDEX(run->page, chip_begin + run->column);
+        PG_lcd_bus_write_data_run(lcd, run->chip, run->page, run->column, &next[idx], run->length);
+    }
+    PG_lcd_unselect_chip(lcd);
+    PG_lcd_metrics_phase(meter, PG_PHASE_BUS);
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        if(dirty_begin[page] < dirty_end[page]) {
+            int idx = PG_BUFFER_INDEX(page, dirty_begin[page]);
+            memcpy(&lcd->buffer.data[idx], &next[idx], dirty_end[page] - dirty_begin[page]);
+        }
+    }
+    if(lcd->backend == PG_BACKEND_EMU) {
+        PG_lcd_emu_check_model(lcd);
+    }
+
+    struct PG_refresh_stats_t *stats = &lcd->refresh_stats;
+    stats->planned_cycles = planned_cycles;
+    stats->naive_cycles = naive_cycles;
+    stats->runs = run_count;
+    stats->total_planned_cycles += planned_cycles;
+    stats->total_naive_cycles += naive_cycles;
+}
+
+static void PG_lcd_render_dirty(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer, const uint16_t *dirty_begin, const uint16_t *dirty_end)
+{
+    PG_lcd_render_begin(lcd);
+    PG_lcd_refresh(lcd, lcd, buffer, dirty_begin, dirty_end);
+    lcd->frame_end_callback(lcd);
+    PG_lcd_metrics_phase(lcd, PG_PHASE_FRAME_END);
+    PG_lcd_render_end(lcd);
+}
+
+// 지난번과 같은 buffer면 그린 구간만 비교한다. 다른 buffer면 전체를 비교한다
+void PG_lcd_render_buffer(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer)
+{
+    uint16_t full_begin[PG_PAGES];
+    uint16_t full_end[PG_PAGES];
+    const uint16_t *dirty_begin = buffer->dirty_begin;
+    const uint16_t *dirty_end = buffer->dirty_end;
+    if(lcd->dirty_source != buffer) {
+        for(int page = 0 ; page < lcd->pages ; ++page) {
+            full_begin[page] = 0;
+            full_end[page] = lcd->columns;
+        }
+        dirty_begin = full_begin;
+        dirty_end = full_end;
+    }
+    PG_lcd_render_dirty(lcd, buffer, dirty_begin, dirty_end);
+
+    // 이제 lcd->buffer와 buffer가 같다
+    PG_framebuffer_dirty_reset(buffer);
+    lcd->dirty_source = buffer;
+}
+
+void PG_lcd_render_region(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer, int x, int y, int w, int h)
+{
+    uint16_t region_begin[PG_PAGES];
+    uint16_t region_end[PG_PAGES];
+    for(int page = 0 ; page < lcd->pages ; ++page) {
+        region_begin[page] = 0;
+        region_end[page] = 0;
+    }
+
+    int x_begin = (x < 0) ? 0 : x;
+    int x_end = (x + w > lcd->columns) ? lcd->columns : x + w;
+    int y_begin = (y < 0) ? 0 : y;
+    int y_end = (y + h > lcd->rows) ? lcd->rows : y + h;
+    if(x_begin < x_end && y_begin < y_end) {
+        for(int page = y_begin / 8 ; page <= (y_end - 1) / 8 ; ++page) {
+            region_begin[page] = x_begin;
+            region_end[page] = x_end;
+        }
+    }
+    PG_lcd_render_dirty(lcd, buffer, region_begin, region_end);
+
+    // 영역 밖은 buffer와 lcd->buffer가 다를수 있다
+    // 다른 buffer였으면 지금 dirty_source의 기록은 더이상 맞지 않는다
+    if(lcd->dirty_source != buffer) {
+        lcd->dirty_source = NULL;
+    }
+}
+
+// hardware scroll
+void PG_lcd_scroll(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer, int rows)
+{
+    rows %= lcd->rows;
+    if(rows == 0) {
+        return;
+    }
+    int distance = (rows > 0) ? rows : -rows;
+
+    // 내용을 민다. 위로 밀면 row r <- row r + rows
+    for(int column = 0 ; column < lcd->columns ; ++column) {
+        uint64_t bits = PG_framebuffer_column_get(buffer, column);
+        bits = (rows > 0) ? (bits >> distance) : (bits << distance);
+        PG_framebuffer_column_set(buffer, column, bits);
+    }
+
+    // 이미 있던 dirty 구간도 같이 움직이고, 새로 드러난 row는 전부 dirty
+    uint16_t prev_begin[PG_PAGES];
+    uint16_t prev_end[PG_PAGES];
+    memcpy(prev_begin, buffer->dirty_begin, sizeof(prev_begin));
+    memcpy(prev_end, buffer->dirty_end, sizeof(prev_end));
+    PG_framebuffer_dirty_reset(buffer);
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        if(prev_begin[page] >= prev_end[page]) {
+            continue;
+        }
+        int width = prev_end[page] - prev_begin[page];
+        PG_framebuffer_mark_dirty(buffer, prev_begin[page], page * 8 - rows, width, 8);
+    }
+    int exposed_y = (rows > 0) ? lcd->rows - distance : 0;
+    PG_framebuffer_mark_dirty(buffer, 0, exposed_y, lcd->columns, distance);
+
+    // 화면 row r = RAM row (r + start_line). buffer를 따라가려면 start line도 rows만큼
+    bool tracked = (lcd->dirty_source == buffer);
+    PG_lcd_set_start_line(lcd, (lcd->start_line + rows + lcd->rows) % lcd->rows);
+    if(tracked) {
+        lcd->dirty_source = buffer;
+    }
+}
+
+// shared bus
+void PG_bus_initialize(struct PG_bus_t *bus)
+{
+    memset(bus, 0, sizeof(*bus));
+    memset(bus->lines.pin_shadow, -1, sizeof(bus->lines.pin_shadow));
+}
+
+int PG_bus_attach(struct PG_bus_t *bus, struct PG_lcd_t *lcd)
+{
+    if(bus->panel_count >= PG_BUS_MAX_PANELS) {
+        return 1;
+    }
+    bus->panel_list[bus->panel_count++] = lcd;
+    lcd->bus = bus;
+    lcd->lines = &bus->lines;
+    PG_lcd_shadow_invalidate(lcd);
+    return 0;
+}
+
+// 화면 내용이 같아서 같은 byte를 같이 받을수 있는지
+static bool PG_bus_can_mirror(struct PG_lcd_t *a, const struct PG_framebuffer_t *a_buffer, struct PG_lcd_t *b, const struct PG_framebuffer_t *b_buffer)
+{
+    if(a->chips != b->chips || a->start_line != b->start_line) {
+        return false;
+    }
+    if(a_buffer == b_buffer) {
+        return true;
+    }
+    for(int page = 0 ; page < a->pages ; ++page) {
+        int idx = PG_BUFFER_INDEX(page, 0);
+        if(memcmp(&a_buffer->data[idx], &b_buffer->data[idx], a->columns) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 내용이 같은 panel끼리 묶어서 leader 하나만 planning하고
+// 나머지는 CS를 같이 켜서 같은 bus cycle을 받게 한다
+void PG_bus_render(struct PG_bus_t *bus, struct PG_framebuffer_t **buffer_list)
+{
+    if(bus->panel_count == 0) {
+        return;
+    }
+    struct PG_lcd_t *host = bus->panel_list[0];
+    PG_lcd_render_begin(host);
+
+    uint16_t full_begin[PG_PAGES];
+    uint16_t full_end[PG_PAGES];
+    bool done_list[PG_BUS_MAX_PANELS] = { false };
+    for(int i = 0 ; i < bus->panel_count ; ++i) {
+        if(done_list[i]) {
+            continue;
+        }
+        struct PG_lcd_t *leader = bus->panel_list[i];
+        leader->mirror_count = 0;
+        for(int j = i + 1 ; j < bus->panel_count ; ++j) {
+            struct PG_lcd_t *panel = bus->panel_list[j];
+            if(!done_list[j] && PG_bus_can_mirror(leader, buffer_list[i], panel, buffer_list[j])) {
+                leader->mirror_list[leader->mirror_count++] = panel;
+                done_list[j] = true;
+            }
+        }
+
+        // 주소 레지스터가 다르면 leader 모델을 버려서 주소 명령이 모두에게 가게 한다
+        for(int m = 0 ; m < leader->mirror_count ; ++m) {
+            struct PG_lcd_t *mirror = leader->mirror_list[m];
+            for(int chip = 0 ; chip < leader->chips ; ++chip) {
+                if(mirror->chip_page[chip] != leader->chip_page[chip]) {
+                    leader->chip_page[chip] = -1;
+                }
+                if(mirror->chip_column[chip] != leader->chip_column[chip]) {
+                    leader->chip_column[chip] = -1;
+                }
+            }
+        }
+
+        // 혼자면 지난번 dirty 구간을 쓰고, 묶였으면 모두의 RAM과 비교한다
+        const uint16_t *dirty_begin = buffer_list[i]->dirty_begin;
+        const uint16_t *dirty_end = buffer_list[i]->dirty_end;
+        if(leader->mirror_count > 0 || leader->dirty_source != buffer_list[i]) {
+            for(int page = 0 ; page < leader->pages ; ++page) {
+                full_begin[page] = 0;
+                full_end[page] = leader->columns;
+            }
+            dirty_begin = full_begin;
+            dirty_end = full_end;
+        }
+        PG_lcd_refresh(leader, host, buffer_list[i], dirty_begin, dirty_end);
+
+        for(int m = 0 ; m < leader->mirror_count ; ++m) {
+            struct PG_lcd_t *mirror = leader->mirror_list[m];
+            memcpy(mirror->buffer.data, leader->buffer.data, sizeof(mirror->buffer.data));
+            memcpy(mirror->chip_page, leader->chip_page, sizeof(mirror->chip_page));
+            memcpy(mirror->chip_column, leader->chip_column, sizeof(mirror->chip_column));
+        }
+        leader->mirror_count = 0;
+    }
+
+    // 이제 모든 panel이 자기 buffer와 같다
+    for(int i = 0 ; i < bus->panel_count ; ++i) {
+        struct PG_lcd_t *panel = bus->panel_list[i];
+        PG_framebuffer_dirty_reset(buffer_list[i]);
+        panel->dirty_source = buffer_list[i];
+        panel->frame_end_callback(panel);
+    }
+    PG_lcd_metrics_phase(host, PG_PHASE_FRAME_END);
+    PG_lcd_render_end(host);
+}
+
+// bus trace recorder
+// 단일 producer. 읽는 쪽은 seqlock처럼 head를 다시 읽어서 덮어써진 slot을 버린다
+// slot은 relaxed로 접근한다. x86/arm 모두 일반 load/store가 된다
+static void PG_trace_record(struct PG_trace_t *trace, PG_trace_type_t type, uint8_t chip_mask, uint8_t pin, uint8_t value, uint32_t count)
+{
+    uint64_t head = trace->head;
+    struct PG_trace_event_t *event = &trace->event_list[head & (PG_TRACE_CAPACITY - 1)];
+    // 이전 head 갱신이 slot 덮어쓰기보다 먼저 보이게 한다
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&event->time_ns, trace->now_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->type, type, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->chip_mask, chip_mask, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->pin, pin, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->count, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void PG_trace_copy_event(struct PG_trace_event_t *dst, const struct PG_trace_event_t *src)
+{
+    dst->time_ns = __atomic_load_n(&src->time_ns, __ATOMIC_RELAXED);
+    dst->type = __atomic_load_n(&src->type, __ATOMIC_RELAXED);
+    dst->chip_mask = __atomic_load_n(&src->chip_mask, __ATOMIC_RELAXED);
+    dst->pin = __atomic_load_n(&src->pin, __ATOMIC_RELAXED);
+    dst->value = __atomic_load_n(&src->value, __ATOMIC_RELAXED);
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+}
+
+// pin 변경마다 시계를 읽지 않는다. pin event는 마지막 bus 전송 시각을 쓴다
+static void PG_trace_tick(struct PG_trace_t *trace)
+{
+    trace->now_ns = PG_timing_now_ns() - trace->begin_ns;
+}
+
+static uint8_t PG_trace_chip_mask(struct PG_lcd_t *lcd, int chip)
+{
+    if(chip == PG_CHIP_ALL) {
+        return (1 << lcd->chips) - 1;
+    }
+    return 1 << chip;
+}
+
+static void PG_trace_pin_set_val(struct PG_lcd_t *lcd, uint8_t pin, int val)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    val = (val != 0);
+    int role = -1;
+    if(pin == lcd->pin_rs) {
+        trace->val_rs = val;
+        role = PG_TRACE_PIN_RS;
+    } else if(pin == lcd->pin_rw) {
+        trace->val_rw = val;
+        role = PG_TRACE_PIN_RW;
+    } else if(pin == lcd->pin_rst) {
+        role = PG_TRACE_PIN_RST;
+    } else if(pin == lcd->pin_led) {
+        role = PG_TRACE_PIN_LED;
+    } else {
+        for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+            if(pin == PG_lcd_chip_pin(lcd, chip)) {
+                trace->val_cs_mask = val ? (trace->val_cs_mask | (1 << chip)) : (trace->val_cs_mask & ~(1 << chip));
+                role = PG_TRACE_PIN_CS1 + chip;
+            }
+        }
+    }
+    if(role < 0 && pin != lcd->pin_e) {
+        uint8_t data_pin_list[DATA_PIN_COUNT];
+        PG_lcd_fill_data_pin(lcd, data_pin_list);
+        for(int i = 0 ; i < DATA_PIN_COUNT ; ++i) {
+            if(data_pin_list[i] == pin) {
+                trace->val_data = val ? (trace->val_data | (1 << i)) : (trace->val_data & ~(1 << i));
+            }
+        }
+    }
+    if(role >= 0 && trace->depth == 0) {
+        PG_trace_record(trace, PG_TRACE_PIN, 0, role, val, 0);
+    }
+    trace->inner_pin_set_val(lcd, pin, val);
+}
+
+static void PG_trace_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    if(trace->val_rs != rs && trace->depth == 0) {
+        PG_trace_record(trace, PG_TRACE_PIN, 0, PG_TRACE_PIN_RS, rs, 0);
+    }
+    trace->val_rs = rs;
+    trace->val_data = data;
+    trace->inner_write_bus(lcd, rs, data);
+}
+
+static void PG_trace_pulse(struct PG_lcd_t *lcd)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    if(trace->depth == 0 && !trace->val_rw && trace->val_cs_mask != 0) {
+        PG_trace_tick(trace);
+        if(trace->val_rs) {
+            PG_trace_record(trace, PG_TRACE_DATA, trace->val_cs_mask, 0, trace->val_data, 0);
+            trace->data_bytes++;
+        } else {
+            PG_trace_record(trace, PG_TRACE_COMMAND, trace->val_cs_mask, 0, trace->val_data, 0);
+        }
+    }
+    trace->inner_pulse(lcd);
+}
+
+static void PG_trace_write_command(struct PG_lcd_t *lcd, int chip, uint8_t cmd)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    if(trace->depth == 0) {
+        PG_trace_tick(trace);
+        PG_trace_record(trace, PG_TRACE_COMMAND, PG_trace_chip_mask(lcd, chip), 0, cmd, 0);
+    }
+    trace->depth++;
+    trace->inner_write_command(lcd, chip, cmd);
+    trace->depth--;
+}
+
+// backend가 주소 명령을 생략했을수 있지만 replay할수 있게 page/column을 항상 남긴다
+static void PG_trace_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    if(trace->depth == 0) {
+        PG_trace_tick(trace);
+        uint8_t chip_mask = PG_trace_chip_mask(lcd, chip);
+        PG_trace_record(trace, PG_TRACE_COMMAND, chip_mask, 0, MASK_SET_PAGE | page, 0);
+        PG_trace_record(trace, PG_TRACE_COMMAND, chip_mask, 0, MASK_SET_COLUMN | column, 0);
+        for(int i = 0 ; i < length ; ++i) {
+            PG_trace_record(trace, PG_TRACE_DATA, chip_mask, 0, data[i], 0);
+        }
+        trace->data_bytes += length;
+    }
+    trace->depth++;
+    trace->inner_write_data_run(lcd, chip, page, column, data, length);
+    trace->depth--;
+}
+
+static void PG_trace_chip_broadcast(struct PG_lcd_t *lcd, uint8_t cmd)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    if(trace->depth == 0) {
+        PG_trace_tick(trace);
+        PG_trace_record(trace, PG_TRACE_COMMAND, PG_trace_chip_mask(lcd, PG_CHIP_ALL), 0, cmd, 0);
+    }
+    trace->depth++;
+    trace->inner_chip_broadcast(lcd, cmd);
+    trace->depth--;
+}
+
+static int PG_trace_frame_end_callback(struct PG_lcd_t *lcd)
+{
+    struct PG_trace_t *trace = lcd->trace;
+    uint64_t changed = lcd->lines->counters.changed_bytes - trace->changed_mark;
+    trace->changed_mark = lcd->lines->counters.changed_bytes;
+    trace->changed_bytes += changed;
+    PG_trace_tick(trace);
+    PG_trace_record(trace, PG_TRACE_FRAME, 0, 0, 0, (uint32_t)changed);
+    return trace->inner_frame_end_callback(lcd);
+}
+
+void PG_trace_attach(struct PG_trace_t *trace, struct PG_lcd_t *lcd)
+{
+    assert(lcd->trace == NULL);
+    trace->head = 0;
+    trace->begin_ns = PG_timing_now_ns();
+    trace->now_ns = 0;
+    trace->chips = lcd->chips;
+    trace->val_rs = 0;
+    trace->val_rw = 0;
+    trace->val_data = 0;
+    trace->val_cs_mask = 0;
+    trace->depth = 0;
+    trace->data_bytes = 0;
+    trace->changed_bytes = 0;
+    trace->changed_mark = lcd->lines->counters.changed_bytes;
+
+    trace->lcd = lcd;
+    trace->inner_pin_set_val = lcd->pin_set_val;
+    trace->inner_write_bus = lcd->write_bus;
+    trace->inner_pulse = lcd->pulse;
+    trace->inner_write_command = lcd->write_command;
+    trace->inner_write_data_run = lcd->write_data_run;
+    trace->inner_chip_broadcast = lcd->chip_broadcast;
+    trace->inner_frame_end_callback = lcd->frame_end_callback;
+
+    // 없는 optional op는 그대로 NULL로 둬서 pin level fallback이 유지되게 한다
+    lcd->pin_set_val = PG_trace_pin_set_val;
+    lcd->pulse = PG_trace_pulse;
+    lcd->frame_end_callback = PG_trace_frame_end_callback;
+    if(lcd->write_bus != NULL) {
+        lcd->write_bus = PG_trace_write_bus;
+    }
+    if(lcd->write_command != NULL) {
+        lcd->write_command = PG_trace_write_command;
+    }
+    if(lcd->write_data_run != NULL) {
+        lcd->write_data_run = PG_trace_write_data_run;
+    }
+    if(lcd->chip_broadcast != NULL) {
+        lcd->chip_broadcast = PG_trace_chip_broadcast;
+    }
+    lcd->trace = trace;
+}
+
+void PG_trace_detach(struct PG_trace_t *trace)
+{
+    struct PG_lcd_t *lcd = trace->lcd;
+    if(lcd == NULL) {
+        return;
+    }
+    lcd->pin_set_val = trace->inner_pin_set_val;
+    lcd->write_bus = trace->inner_write_bus;
+    lcd->pulse = trace->inner_pulse;
+    lcd->write_command = trace->inner_write_command;
+    lcd->write_data_run = trace->inner_write_data_run;
+    lcd->chip_broadcast = trace->inner_chip_broadcast;
+    lcd->frame_end_callback = trace->inner_frame_end_callback;
+    lcd->trace = NULL;
+    trace->lcd = NULL;
+}
+
+uint32_t PG_trace_snapshot(const struct PG_trace_t *trace, struct PG_trace_event_t *event_list, uint32_t capacity)
+{
+    uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    uint64_t first = (head > PG_TRACE_CAPACITY) ? head - PG_TRACE_CAPACITY : 0;
+    if(head - first > capacity) {
+        first = head - capacity;
+    }
+    for(uint64_t i = first ; i < head ; ++i) {
+        PG_trace_copy_event(&event_list[i - first], &trace->event_list[i & (PG_TRACE_CAPACITY - 1)]);
+    }
+
+    // 복사하는 동안 producer가 덮어썼을수 있는 앞부분은 버린다
+    // head2번째 event를 쓰는 중인 slot도 포함한다
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t head2 = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+    uint64_t valid = (head2 + 1 > PG_TRACE_CAPACITY) ? head2 + 1 - PG_TRACE_CAPACITY : 0;
+    if(valid <= first) {
+        return (uint32_t)(head - first);
+    }
+    if(valid >= head) {
+        return 0;
+    }
+    uint32_t skip = (uint32_t)(valid - first);
+    memmove(event_list, &event_list[skip], (head - valid) * sizeof(event_list[0]));
+    return (uint32_t)(head - valid);
+}
+
+int PG_trace_dump(const struct PG_trace_t *trace, const char *path)
+{
+    struct PG_trace_event_t *event_list = malloc(PG_TRACE_CAPACITY * sizeof(event_list[0]));
+    if(event_list == NULL) {
+        return 1;
+    }
+    uint32_t count = PG_trace_snapshot(trace, event_list, PG_TRACE_CAPACITY);
+
+    struct PG_trace_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PG_TRACE_MAGIC, sizeof(header.magic));
+    header.version = PG_TRACE_VERSION;
+    header.event_size = sizeof(struct PG_trace_event_t);
+    header.chips = trace->chips;
+    header.event_count = count;
+
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        free(event_list);
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(event_list, sizeof(event_list[0]), count, fp) == count;
+    ok = (fclose(fp) == 0) && ok;
+    free(event_list);
+    return ok ? 0 : 1;
+}
+
+int PG_trace_load(struct PG_trace_t *trace, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return 1;
+    }
+    struct PG_trace_file_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && memcmp(header.magic, PG_TRACE_MAGIC, sizeof(header.magic)) == 0;
+    ok = ok && header.version == PG_TRACE_VERSION;
+    ok = ok && header.event_size == sizeof(struct PG_trace_event_t);
+    ok = ok && header.event_count <= PG_TRACE_CAPACITY;
+    ok = ok && header.chips >= 1 && header.chips <= PG_MAX_CHIPS;
+    ok = ok && fread(trace->event_list, sizeof(trace->event_list[0]), header.event_count, fp) == header.event_count;
+    fclose(fp);
+    if(!ok) {
+        fprintf(stderr, "%s is not a piglcd trace\n", path);
+        return 1;
+    }
+    trace->head = header.event_count;
+    trace->chips = header.chips;
+    trace->lcd = NULL;
+    trace->data_bytes = 0;
+    trace->changed_bytes = 0;
+    for(uint32_t i = 0 ; i < header.event_count ; ++i) {
+        const struct PG_trace_event_t *event = &trace->event_list[i];
+        trace->data_bytes += (event->type == PG_TRACE_DATA);
+        trace->changed_bytes += (event->type == PG_TRACE_FRAME) ? event->count : 0;
+    }
+    return 0;
+}
+
+// mask가 chip 하나나 전부가 아니면 CS를 하나씩 맞춘다
+static void PG_trace_select(struct PG_lcd_t *lcd, uint8_t chip_mask)
+{
+    uint8_t all_mask = (1 << lcd->chips) - 1;
+    chip_mask &= all_mask;
+    if(chip_mask == all_mask) {
+        PG_lcd_select_chip(lcd, PG_CHIP_ALL);
+    } else if((chip_mask & (chip_mask - 1)) == 0 && chip_mask != 0) {
+        PG_lcd_select_chip(lcd, __builtin_ctz(chip_mask));
+    } else {
+        for(int chip = 0 ; chip < lcd->chips ; ++chip) {
+            PG_lcd_pin_set(lcd, PG_lcd_chip_pin(lcd, chip), (chip_mask >> chip) & 1);
+        }
+        lcd->selected_chip = -1;
+    }
+}
+
+void PG_trace_replay(const struct PG_trace_t *trace, struct PG_lcd_t *lcd)
+{
+    uint64_t head = trace->head;
+    uint64_t first = (head > PG_TRACE_CAPACITY) ? head - PG_TRACE_CAPACITY : 0;
+    for(uint64_t i = first ; i < head ; ++i) {
+        const struct PG_trace_event_t *event = &trace->event_list[i & (PG_TRACE_CAPACITY - 1)];
+        switch(event->type) {
+            case PG_TRACE_COMMAND:
+            case PG_TRACE_DATA:
+                PG_trace_select(lcd, event->chip_mask);
+                PG_lcd_write_bus(lcd, event->type == PG_TRACE_DATA, event->value);
+                PG_lcd_pulse(lcd);
+                break;
+            case PG_TRACE_PIN:
+                if(event->pin == PG_TRACE_PIN_RST) {
+                    PG_lcd_pin_set(lcd, lcd->pin_rst, event->value);
+                } else if(event->pin == PG_TRACE_PIN_LED) {
+                    PG_lcd_pin_set(lcd, lcd->pin_led, event->value);
+                }
+                break;
+            case PG_TRACE_FRAME:
+                lcd->frame_end_callback(lcd);
+                break;
+            default:
+                break;
+        }
+    }
+    PG_lcd_unselect_chip(lcd);
+    // 직접 보낸 명령은 address model과 dirty 기준에 반영되지 않았다
+    PG_lcd_model_invalidate(lcd);
+    lcd->dirty_source = NULL;
+}
+
+double PG_trace_write_amplification(const struct PG_trace_t *trace)
+{
+    if(trace->changed_bytes == 0) {
+        return 0;
+    }
+    return trace->data_bytes / (double)trace->changed_bytes;
+}
+
+// async render
+int PG_lcd_start_async(struct PG_lcd_t *lcd)
+{
+    if(lcd->async_running) {
+        return 0;
+    }
+    lcd->async_back = 0;
+    lcd->async_middle = 1;
+    lcd->async_front = 2;
+    lcd->async_submit_seq = 0;
+    lcd->async_done_seq = 0;
+    lcd->async_stop = false;
+    memset(lcd->async_slot_seq, 0, sizeof(lcd->async_slot_seq));
+    pthread_mutex_init(&lcd->async_mutex, NULL);
+    pthread_cond_init(&lcd->async_frame_cond, NULL);
+    pthread_cond_init(&lcd->async_done_cond, NULL);
+
+    // gl context는 render thread로 넘긴다
+    if(lcd->glfw_window != NULL) {
+        glfwMakeContextCurrent(NULL);
+    }
+    lcd->async_running = true;
+    if(pthread_create(&lcd->async_thread, NULL, PG_lcd_async_main, lcd) != 0) {
+        fprintf(stderr, "cannot create render thread\n");
+        lcd->async_running = false;
+        if(lcd->glfw_window != NULL) {
+            glfwMakeContextCurrent(lcd->glfw_window);
+        }
+        pthread_cond_destroy(&lcd->async_done_cond);
+        pthread_cond_destroy(&lcd->async_frame_cond);
+        pthread_mutex_destroy(&lcd->async_mutex);
+        return 1;
+    }
+    return 0;
+}
+
+void *PG_lcd_async_main(void *arg)
+{
+    struct PG_lcd_t *lcd = (struct PG_lcd_t*)arg;
+    if(lcd->glfw_window != NULL) {
+        glfwMakeContextCurrent(lcd->glfw_window);
+    }
+
+    for(;;) {
+        uint32_t middle = __atomic_load_n(&lcd->async_middle, __ATOMIC_ACQUIRE);
+        if(middle & PG_ASYNC_FRESH) {
+            // 최신 frame을 가져오고 다 쓴 front를 돌려준다
+            middle = __atomic_exchange_n(&lcd->async_middle, lcd->async_front, __ATOMIC_ACQ_REL);
+            lcd->async_front = middle & PG_ASYNC_SLOT_MASK;
+
+            uint64_t seq = lcd->async_slot_seq[lcd->async_front];
+            uint64_t done_seq = __atomic_load_n(&lcd->async_done_seq, __ATOMIC_RELAXED);
+            lcd->async_dropped_count += seq - done_seq - 1;
+
+            PG_lcd_render_buffer(lcd, &lcd->async_slot[lcd->async_front]);
+
+            pthread_mutex_lock(&lcd->async_mutex);
+            __atomic_store_n(&lcd->async_done_seq, seq, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&lcd->async_done_cond);
+            pthread_mutex_unlock(&lcd->async_mutex);
+            continue;
+        }
+
+        // 새 frame이 없으면 잔다. submit은 mutex를 잡고 깨우므로 신호를 놓치지 않는다
+        pthread_mutex_lock(&lcd->async_mutex);
+        while(!(__atomic_load_n(&lcd->async_middle, __ATOMIC_ACQUIRE) & PG_ASYNC_FRESH) && !lcd->async_stop) {
+            pthread_cond_wait(&lcd->async_frame_cond, &lcd->async_mutex);
+        }
+        bool stop = lcd->async_stop && !(__atomic_load_n(&lcd->async_middle, __ATOMIC_ACQUIRE) & PG_ASYNC_FRESH);
+        pthread_mutex_unlock(&lcd->async_mutex);
+        if(stop) {
+            break;
+        }
+    }
+
+    if(lcd->glfw_window != NULL) {
+        glfwMakeContextCurrent(NULL);
+    }
+    return NULL;
+}
+
+// buffer를 back slot에 복사하고 middle과 바꾼다. 전송을 기다리지 않는다
+int PG_lcd_submit_async(struct PG_lcd_t *lcd, const struct PG_framebuffer_t *buffer)
+{
+    if(!lcd->async_running && PG_lcd_start_async(lcd) != 0) {
+        return 1;
+    }
+    uint32_t back = lcd->async_back;
+    memcpy(&lcd->async_slot[back], buffer, sizeof(struct PG_framebuffer_t));
+    // slot은 매번 다른 frame을 담으므로 dirty 기록을 믿을수 없다
+    PG_framebuffer_mark_all_dirty(&lcd->async_slot[back]);
+    lcd->async_slot_seq[back] = ++lcd->async_submit_seq;
+
+    uint32_t prev = __atomic_exchange_n(&lcd->async_middle, back | PG_ASYNC_FRESH, __ATOMIC_ACQ_REL);
+    lcd->async_back = prev & PG_ASYNC_SLOT_MASK;
+
+    pthread_mutex_lock(&lcd->async_mutex);
+    pthread_cond_signal(&lcd->async_frame_cond);
+    pthread_mutex_unlock(&lcd->async_mutex);
+    return 0;
+}
+
+void PG_lcd_flush_async(struct PG_lcd_t *lcd)
+{
+    if(!lcd->async_running) {
+        return;
+    }
+    pthread_mutex_lock(&lcd->async_mutex);
+    while(__atomic_load_n(&lcd->async_done_seq, __ATOMIC_ACQUIRE) < lcd->async_submit_seq) {
+        pthread_cond_wait(&lcd->async_done_cond, &lcd->async_mutex);
+    }
+    pthread_mutex_unlock(&lcd->async_mutex);
+}
+
+void PG_lcd_stop_async(struct PG_lcd_t *lcd)
+{
+    if(!lcd->async_running) {
+        return;
+    }
+    pthread_mutex_lock(&lcd->async_mutex);
+    lcd->async_stop = true;
+    pthread_cond_signal(&lcd->async_frame_cond);
+    pthread_mutex_unlock(&lcd->async_mutex);
+    pthread_join(lcd->async_thread, NULL);
+
+    lcd->async_running = false;
+    pthread_cond_destroy(&lcd->async_done_cond);
+    pthread_cond_destroy(&lcd->async_frame_cond);
+    pthread_mutex_destroy(&lcd->async_mutex);
+    if(lcd->glfw_window != NULL) {
+        glfwMakeContextCurrent(lcd->glfw_window);
+    }
+}
+
+// framebuffer impl
+// dirty tracking
+void PG_framebuffer_dirty_reset(struct PG_framebuffer_t *buffer)
+{
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        buffer->dirty_begin[page] = PG_MAX_COLUMNS;
+        buffer->dirty_end[page] = 0;
+    }
+}
+
+// page의 [begin, end) column을 dirty 구간에 합친다
+void PG_framebuffer_dirty_span(struct PG_framebuffer_t *buffer, int page, int begin, int end)
+{
+    if(page < 0 || page >= PG_PAGES) { return; }
+    if(begin < 0) { begin = 0; }
+    if(end > PG_MAX_COLUMNS) { end = PG_MAX_COLUMNS; }
+    if(begin >= end) { return; }
+    if(begin < buffer->dirty_begin[page]) { buffer->dirty_begin[page] = begin; }
+    if(end > buffer->dirty_end[page]) { buffer->dirty_end[page] = end; }
+}
+
+void PG_framebuffer_mark_dirty(struct PG_framebuffer_t *buffer, int x, int y, int w, int h)
+{
+    if(w <= 0 || h <= 0) {
+        return;
+    }
+    int y_begin = (y < 0) ? 0 : y;
+    int y_end = y + h;
+    if(y_end <= 0) {
+        return;
+    }
+    for(int page = y_begin / 8 ; page <= (y_end - 1) / 8 && page < PG_PAGES ; ++page) {
+        PG_framebuffer_dirty_span(buffer, page, x, x + w);
+    }
+}
+
+// column 하나의 page 8개를 64bit로. bit r = row r
+uint64_t PG_framebuffer_column_get(const struct PG_framebuffer_t *buffer, int column)
+{
+    uint64_t bits = 0;
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        bits |= (uint64_t)buffer->data[PG_BUFFER_INDEX(page, column)] << (page * 8);
+    }
+    return bits;
+}
+
+void PG_framebuffer_column_set(struct PG_framebuffer_t *buffer, int column, uint64_t bits)
+{
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        buffer->data[PG_BUFFER_INDEX(page, column)] = (uint8_t)(bits >> (page * 8));
+    }
+}
+
+void PG_framebuffer_mark_all_dirty(struct PG_framebuffer_t *buffer)
+{
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        buffer->dirty_begin[page] = 0;
+        buffer->dirty_end[page] = PG_MAX_COLUMNS;
+    }
+}
+
+void PG_framebuffer_clear(struct PG_framebuffer_t *buffer)
+{
+    // 처음 쓰는 buffer면 columns가 범위 밖일수 있다. 그때만 기본 geometry
+    int columns = buffer->columns;
+    if(columns <= 0 || columns > PG_MAX_COLUMNS) {
+        columns = PG_DEFAULT_COLUMNS;
+    }
+    PG_framebuffer_initialize(buffer, columns);
+}
+
+void PG_framebuffer_initialize(struct PG_framebuffer_t *buffer, int columns)
+{
+    assert(columns > 0 && columns <= PG_MAX_COLUMNS);
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->columns = columns;
+    buffer->width = columns;
+    buffer->height = PG_PAGES;
+    buffer->curr_x = 0;
+    buffer->curr_y = 0;
+    PG_framebuffer_mark_all_dirty(buffer);
+}
+
+void PG_framebuffer_erase(struct PG_framebuffer_t *buffer)
+{
+    memset(buffer->data, 0, sizeof(buffer->data));
+    PG_framebuffer_mark_all_dirty(buffer);
+}
+
+void PG_framebuffer_write_sample_pattern(struct PG_framebuffer_t *buffer)
+{
+    for(int page = 0 ; page < PG_PAGES ; ++page) {
+        for(int column = 0 ; column < PG_MAX_COLUMNS ; ++column) {
+            uint8_t data = (column % 2) ? 0b10101010 : 0b01010101;
+            buffer->data[PG_BUFFER_INDEX(page, column)] = data;
+        }
+    }
+    PG_framebuffer_mark_all_dirty(buffer);
+}
+
+void PG_framebuffer_draw_bitmap(struct PG_framebuffer_t *buffer, PG_image_t data)
+{
+    int width = data[0];
+    int height = data[1];
+    // columns(그리기 clip 폭)는 그대로 둔다. width/height는 그림 크기
+    buffer->width = width;
+    buffer->height = height;
+    for(int page = 0 ; page < (height / 8) ; ++page) {
+        for(int column = 0 ; column < width ; ++column) {
+            uint8_t elem = data[page * width + column + 2];
+            buffer->data[PG_BUFFER_INDEX(page, column)] = elem;
+        }
+        PG_framebuffer_dirty_span(buffer, page, 0, width);
+    }
+}
+void PG_framebuffer_cursor_to_xy(struct PG_framebuffer_t *buffer, int x, int y)
+{
+    buffer->curr_x = x;
+    buffer->curr_y = y;
+}
+void PG_framebuffer_overlay_assign(struct PG_framebuffer_t *dst, struct PG_framebuffer_t *src, int x, int y)
+{
+    PG_framebuffer_blit(dst, x, y, src, 0, 0, src->width, (src->height / 8) * 8, PG_ROP_COPY, NULL);
+}
+
+// blitter
+// page 하나의 column 8개 = 8byte = uint64 하나로 처리한다. byte마다 독립이라 endian과 상관없다
+#define BLIT_LANES 0x0101010101010101ULL
+
+// rop = (dst, src) truth table. bit (d * 2 + s)가 결과
+static const uint8_t BLIT_ROP_TABLE[PG_ROP_MAX_COUNT] = {
+    [PG_ROP_COPY] = 0b1010,
+    [PG_ROP_OR] = 0b1110,
+    [PG_ROP_AND] = 0b1000,
+    [PG_ROP_XOR] = 0b0110,
+    [PG_ROP_AND_NOT] = 0b0100,
+    [PG_ROP_MASKED] = 0b1010,
+};
+
+// 범위 밖 page는 빈 page로 읽는다
+static const uint8_t blit_zero_page[PG_MAX_COLUMNS];
+
+static const uint8_t *PG_blit_page(const struct PG_framebuffer_t *buffer, int page)
+{
+    if(page < 0 || page >= PG_PAGES) {
+        return blit_zero_page;
+    }
+    return &buffer->data[PG_BUFFER_INDEX(page, 0)];
+}
+
+static inline uint64_t PG_blit_load(const uint8_t *p)
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline void PG_blit_store(uint8_t *p, uint64_t word)
+{
+    memcpy(p, &word, sizeof(word));
+}
+
+// upper page를 shift만큼 올리고 lower page에서 모자란 row를 채운다. byte lane마다 따로 민다
+static inline uint64_t PG_blit_shift_word(uint64_t upper, uint64_t lower, int shift)
+{
+    if(shift == 0) {
+        return upper;
+    }
+    uint64_t upper_mask = (uint64_t)(0xFF >> shift) * BLIT_LANES;
+    uint64_t lower_mask = (uint64_t)((0xFF << (8 - shift)) & 0xFF) * BLIT_LANES;
+    return ((upper >> shift) & upper_mask) | ((lower << (8 - shift)) & lower_mask);
+}
+
+// truth table bit를 word mask로 편 것
+struct PG_blit_rop_t {
+    uint64_t d0s1;
+    uint64_t d1s0;
+    uint64_t d1s1;
+};
+
+static void PG_blit_rop_table(PG_rop_t rop, struct PG_blit_rop_t *table)
+{
+    uint8_t bits = BLIT_ROP_TABLE[rop];
+    table->d0s1 = (bits & 0b0010) ? ~0ULL : 0;
+    table->d1s0 = (bits & 0b0100) ? ~0ULL : 0;
+    table->d1s1 = (bits & 0b1000) ? ~0ULL : 0;
+}
+
+// row_mask가 1인 bit만 rop 결과로 바꾼다
+static inline uint64_t PG_blit_apply(uint64_t dst, uint64_t src, uint64_t row_mask, const struct PG_blit_rop_t *table)
+{
+    uint64_t result = (~dst & src & table->d0s1) | (dst & ~src & table->d1s0) | (dst & src & table->d1s1);
+    return dst ^ ((dst ^ result) & row_mask);
+}
+
+void PG_framebuffer_blit(struct PG_framebuffer_t *dst, int dst_x, int dst_y,
+                         const struct PG_framebuffer_t *src, int src_x, int src_y, int w, int h,
+                         PG_rop_t rop, const struct PG_framebuffer_t *mask)
+{
+    assert(rop >= 0 && rop < PG_ROP_MAX_COUNT);
+    assert(rop != PG_ROP_MASKED || mask != NULL);
+
+    // src 범위
+    if(src_x < 0) { w += src_x; dst_x -= src_x; src_x = 0; }
+    if(src_y < 0) { h += src_y; dst_y -= src_y; src_y = 0; }
+    if(src_x + w > src->width) { w = src->width - src_x; }
+    if(src_y + h > PG_ROWS) { h = PG_ROWS - src_y; }
+    // dst 범위
+    if(dst_x < 0) { w += dst_x; src_x -= dst_x; dst_x = 0; }
+    if(dst_y < 0) { h += dst_y; src_y -= dst_y; dst_y = 0; }
+    if(dst_x + w > dst->columns) { w = dst->columns - dst_x; }
+    if(dst_y + h > PG_ROWS) { h = PG_ROWS - dst_y; }
+    if(w <= 0 || h <= 0) {
+        return;
+    }
+
+    // 자기 자신으로 blit하면 읽기 전에 덮어쓸수 있다
+    struct PG_framebuffer_t src_copy;
+    struct PG_framebuffer_t mask_copy;
+    if(src == dst) {
+        memcpy(src_copy.data, src->data, sizeof(src_copy.data));
+        src = &src_copy;
+    }
+    if(rop == PG_ROP_MASKED && mask == dst) {
+        memcpy(mask_copy.data, mask->data, sizeof(mask_copy.data));
+        mask = &mask_copy;
+    }
+
+    struct PG_blit_rop_t table;
+    PG_blit_rop_table(rop, &table);
+
+    // dst row r은 src row r - offset_y
+    int offset_y = dst_y - src_y;
+    int first_page = dst_y / 8;
+    int last_page = (dst_y + h - 1) / 8;
+    for(int page = first_page ; page <= last_page ; ++page) {
+        int row_begin = (dst_y > page * 8) ? dst_y - page * 8 : 0;
+        int row_end = (dst_y + h < page * 8 + 8) ? dst_y + h - page * 8 : 8;
+        uint8_t row_byte = (0xFF << row_begin) & (0xFF >> (8 - row_end));
+
+        int src_row = page * 8 - offset_y;
+        int src_page = (src_row >= 0) ? (src_row / 8) : -((7 - src_row) / 8);
+        int shift = src_row - src_page * 8;
+        const uint8_t *src_upper = PG_blit_page(src, src_page) + src_x;
+        const uint8_t *src_lower = PG_blit_page(src, src_page + 1) + src_x;
+        const uint8_t *mask_upper = NULL;
+        const uint8_t *mask_lower = NULL;
+        if(rop == PG_ROP_MASKED) {
+            mask_upper = PG_blit_page(mask, src_page) + src_x;
+            mask_lower = PG_blit_page(mask, src_page + 1) + src_x;
+        }
+        uint8_t *dst_row = &dst->data[PG_BUFFER_INDEX(page, dst_x)];
+
+        uint64_t row_mask = row_byte * BLIT_LANES;
+        int i = 0;
+        for( ; i + 8 <= w ; i += 8) {
+            uint64_t src_word = PG_blit_shift_word(PG_blit_load(src_upper + i), PG_blit_load(src_lower + i), shift);
+            uint64_t word_mask = row_mask;
+            if(mask_upper != NULL) {
+                word_mask &= PG_blit_shift_word(PG_blit_load(mask_upper + i), PG_blit_load(mask_lower + i), shift);
+            }
+            uint64_t dst_word = PG_blit_load(dst_row + i);
+            PG_blit_store(dst_row + i, PG_blit_apply(dst_word, src_word, word_mask, &table));
+        }
+        // 남은 column은 byte 단위
+        for( ; i < w ; ++i) {
+            uint8_t src_byte = PG_blit_shift_word(src_upper[i], src_lower[i], shift);
+            uint8_t byte_mask = row_byte;
+            if(mask_upper != NULL) {
+                byte_mask &= PG_blit_shift_word(mask_upper[i], mask_lower[i], shift);
+            }
+            dst_row[i] = PG_blit_apply(dst_row[i], src_byte, byte_mask, &table);
+        }
+    }
+
+    PG_framebuffer_mark_dirty(dst, dst_x, dst_y, w, h);
+}
+
+// 도형 그리기
+// 채우는 도형은 page byte 단위 masked span으로 쓴다. pixel마다 read-modify-write 하지 않는다
+// 모든 도형은 pixel을 한번씩만 건드리므로 PG_COLOR_INVERT로 그려도 겹친 곳이 다시 꺼지지 않는다
+#define DRAW_PATTERN_SIZE 8
+#define DRAW_SIN_SCALE 4096
+
+static const uint8_t DRAW_SOLID_PATTERN[DRAW_PATTERN_SIZE] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+// 0 ~ 90도 sin * DRAW_SIN_SCALE
+static const int16_t DRAW_SIN_TABLE[91] = {
+    0, 71, 143, 214, 286, 357, 428, 499, 570, 641,
+    711, 782, 852, 921, 991, 1060, 1129, 1198, 1266, 1334,
+    1401, 1468, 1534, 1600, 1666, 1731, 1796, 1860, 1923, 1986,
+    2048, 2110, 2171, 2231, 2290, 2349, 2408, 2465, 2522, 2578,
+    2633, 2687, 2741, 2793, 2845, 2896, 2946, 2996, 3044, 3091,
+    3138, 3183, 3228, 3271, 3314, 3355, 3396, 3435, 3474, 3511,
+    3547, 3582, 3617, 3650, 3681, 3712, 3742, 3770, 3798, 3824,
+    3849, 3873, 3896, 3917, 3937, 3956, 3974, 3991, 4006, 4021,
+    4034, 4046, 4056, 4065, 4074, 4080, 4086, 4090, 4094, 4095,
+    4096,
+};
+
+// 색은 모두 1로 채운 src에 대한 rop
+static PG_rop_t PG_draw_color_rop(PG_color_t color)
+{
+    assert(color >= 0 && color < PG_COLOR_MAX_COUNT);
+    switch(color) {
+        case PG_COLOR_CLEAR:
+            return PG_ROP_AND_NOT;
+        case PG_COLOR_INVERT:
+            return PG_ROP_XOR;
+        case PG_COLOR_SET:
+        default:
+            return PG_ROP_OR;
+    }
+}
+
+static inline void PG_draw_byte(uint8_t *p, uint8_t mask, PG_color_t color)
+{
+    switch(color) {
+        case PG_COLOR_CLEAR:
+            *p &= ~mask;
+            break;
+        case PG_COLOR_SET:
+            *p |= mask;
+            break;
+        case PG_COLOR_INVERT:
+            *p ^= mask;
+            break;
+        default:
+            break;
+    }
+}
+
+// page의 [x_begin, x_end) column에서 row_byte bit만 pattern과 rop한다
+// pattern은 화면 좌표에 고정된 8x8 tile이다. column x에는 pattern[x % 8]
+static void PG_draw_page_span(struct PG_framebuffer_t *buffer, int page, int x_begin, int x_end, uint8_t row_byte, const uint8_t *pattern, const struct PG_blit_rop_t *table)
+{
+    if(x_begin < 0) { x_begin = 0; }
+    if(x_end > buffer->columns) { x_end = buffer->columns; }
+    if(x_begin >= x_end || row_byte == 0) {
+        return;
+    }
+    // pattern을 두번 이어 두면 어느 column에서 시작해도 8byte를 한번에 읽을수 있다
+    uint8_t pattern_twice[DRAW_PATTERN_SIZE * 2];
+    memcpy(pattern_twice, pattern, DRAW_PATTERN_SIZE);
+    memcpy(pattern_twice + DRAW_PATTERN_SIZE, pattern, DRAW_PATTERN_SIZE);
+    const uint8_t *pattern_row = pattern_twice + x_begin % DRAW_PATTERN_SIZE;
+
+    uint8_t *dst_row = &buffer->data[PG_BUFFER_INDEX(page, x_begin)];
+    int w = x_end - x_begin;
+    uint64_t row_mask = row_byte * BLIT_LANES;
+    uint64_t pattern_word = PG_blit_load(pattern_row);
+    int i = 0;
+    for( ; i + 8 <= w ; i += 8) {
+        PG_blit_store(dst_row + i, PG_blit_apply(PG_blit_load(dst_row + i), pattern_word, row_mask, table));
+    }
+    for( ; i < w ; ++i) {
+        dst_row[i] = PG_blit_apply(dst_row[i], pattern_row[i % DRAW_PATTERN_SIZE], row_byte, table);
+    }
+    PG_framebuffer_dirty_span(buffer, page, x_begin, x_end);
+}
+
+// rect를 page마다 span 하나로 나눈다
+static void PG_draw_rect_span(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, const uint8_t *pattern, PG_rop_t rop)
+{
+    if(y < 0) { h += y; y = 0; }
+    if(y + h > PG_ROWS) { h = PG_ROWS - y; }
+    if(w <= 0 || h <= 0 || x >= buffer->columns || x + w <= 0) {
+        return;
+    }
+    struct PG_blit_rop_t table;
+    PG_blit_rop_table(rop, &table);
+    for(int page = y / 8 ; page <= (y + h - 1) / 8 ; ++page) {
+        int row_begin = (y > page * 8) ? y - page * 8 : 0;
+        int row_end = (y + h < page * 8 + 8) ? y + h - page * 8 : 8;
+        uint8_t row_byte = (0xFF << row_begin) & (0xFF >> (8 - row_end));
+        PG_draw_page_span(buffer, page, x, x + w, row_byte, pattern, &table);
+    }
+}
+
+// column x의 [y_begin, y_end) row. column 하나를 64bit로 보고 page마다 byte 하나
+// dirty는 부르는 쪽이 도형 단위로 표시한다
+static void PG_draw_column_span(struct PG_framebuffer_t *buffer, int x, int y_begin, int y_end, PG_color_t color)
+{
+    if(x < 0 || x >= buffer->columns) {
+        return;
+    }
+    if(y_begin < 0) { y_begin = 0; }
+    if(y_end > PG_ROWS) { y_end = PG_ROWS; }
+    if(y_begin >= y_end) {
+        return;
+    }
+    uint64_t bits = (~0ULL << y_begin) & (~0ULL >> (PG_ROWS - y_end));
+    int first_page = y_begin / 8;
+    int last_page = (y_end - 1) / 8;
+    uint8_t *column = &buffer->data[PG_BUFFER_INDEX(0, x)];
+    switch(color) {
+        case PG_COLOR_CLEAR:
+            for(int page = first_page ; page <= last_page ; ++page) {
+                column[PG_BUFFER_INDEX(page, 0)] &= ~(uint8_t)(bits >> (page * 8));
+            }
+            break;
+        case PG_COLOR_SET:
+            for(int page = first_page ; page <= last_page ; ++page) {
+                column[PG_BUFFER_INDEX(page, 0)] |= (uint8_t)(bits >> (page * 8));
+            }
+            break;
+        case PG_COLOR_INVERT:
+            for(int page = first_page ; page <= last_page ; ++page) {
+                column[PG_BUFFER_INDEX(page, 0)] ^= (uint8_t)(bits >> (page * 8));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// 같은 byte에 떨어지는 pixel을 모았다가 한번에 쓴다
+struct PG_draw_pixel_run_t {
+    int page;
+    int column;
+    uint8_t mask;
+};
+
+static void PG_draw_pixel_flush(struct PG_framebuffer_t *buffer, struct PG_draw_pixel_run_t *run, PG_color_t color)
+{
+    if(run->mask != 0) {
+        PG_draw_byte(&buffer->data[PG_BUFFER_INDEX(run->page, run->column)], run->mask, color);
+        PG_framebuffer_dirty_span(buffer, run->page, run->column, run->column + 1);
+        run->mask = 0;
+    }
+}
+
+static inline void PG_draw_pixel_add(struct PG_framebuffer_t *buffer, struct PG_draw_pixel_run_t *run, int x, int y, PG_color_t color)
+{
+    if(x < 0 || x >= buffer->columns || y < 0 || y >= PG_ROWS) {
+        return;
+    }
+    if(run->mask != 0 && (run->page != y / 8 || run->column != x)) {
+        PG_draw_pixel_flush(buffer, run, color);
+    }
+    run->page = y / 8;
+    run->column = x;
+    run->mask |= 1 << (y % 8);
+}
+
+void PG_framebuffer_draw_hline(struct PG_framebuffer_t *buffer, int x, int y, int w, PG_color_t color)
+{
+    PG_draw_rect_span(buffer, x, y, w, 1, DRAW_SOLID_PATTERN, PG_draw_color_rop(color));
+}
+
+void PG_framebuffer_draw_vline(struct PG_framebuffer_t *buffer, int x, int y, int h, PG_color_t color)
+{
+    assert(color >= 0 && color < PG_COLOR_MAX_COUNT);
+    if(h > 0 && x >= 0 && x < buffer->columns) {
+        PG_draw_column_span(buffer, x, y, y + h, color);
+        PG_framebuffer_mark_dirty(buffer, x, y, 1, h);
+    }
+}
+
+void PG_framebuffer_fill_rect(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, PG_color_t color)
+{
+    PG_draw_rect_span(buffer, x, y, w, h, DRAW_SOLID_PATTERN, PG_draw_color_rop(color));
+}
+
+void PG_framebuffer_fill_pattern(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, const uint8_t pattern[8], PG_rop_t rop)
+{
+    assert(rop >= 0 && rop < PG_ROP_MAX_COUNT && rop != PG_ROP_MASKED);
+    PG_draw_rect_span(buffer, x, y, w, h, pattern, rop);
+}
+
+void PG_framebuffer_draw_rect(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, PG_color_t color)
+{
+    if(w <= 0 || h <= 0) {
+        return;
+    }
+    // 모서리가 두번 그려지지 않게 세로선은 위아래 한 줄씩 뺀다
+    PG_framebuffer_draw_hline(buffer, x, y, w, color);
+    if(h > 1) {
+        PG_framebuffer_draw_hline(buffer, x, y + h - 1, w, color);
+    }
+    if(h > 2) {
+        PG_framebuffer_draw_vline(buffer, x, y + 1, h - 2, color);
+        if(w > 1) {
+            PG_framebuffer_draw_vline(buffer, x + w - 1, y + 1, h - 2, color);
+        }
+    }
 }
 
-void PG_lcd_set_column(struct PG_lcd_t *lcd, int column)
+void PG_framebuffer_draw_line(struct PG_framebuffer_t *buffer, int x0, int y0, int x1, int y1, PG_color_t color)
 {
-    column = column & ((1 << DATA_BITS_SET_COLUMN) - 1);
+    assert(color >= 0 && color < PG_COLOR_MAX_COUNT);
+    if(x0 == x1) {
+        PG_framebuffer_draw_vline(buffer, x0, (y0 < y1) ? y0 : y1, abs(y1 - y0) + 1, color);
+        return;
+    }
+    if(y0 == y1) {
+        PG_framebuffer_draw_hline(buffer, (x0 < x1) ? x0 : x1, y0, abs(x1 - x0) + 1, color);
+        return;
+    }
+    // 양 끝이 같은 쪽 화면 밖이면 그릴 것이 없다
+    if((x0 < 0 && x1 < 0) || (y0 < 0 && y1 < 0) ||
+       (x0 >= buffer->columns && x1 >= buffer->columns) || (y0 >= PG_ROWS && y1 >= PG_ROWS)) {
+        return;
+    }
 
-    // 0 1 ? ? ? ? ? ?
-    uint8_t data = MASK_SET_COLUMN | column;
-    PG_lcd_write_data_bit(lcd, data);
-    lcd->pulse(lcd);
+    // Bresenham. 세로로 긴 선은 한 page 안의 pixel이 byte 하나로 모인다
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = (x0 < x1) ? 1 : -1;
+    int step_y = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+    struct PG_draw_pixel_run_t run = { 0, 0, 0 };
+    while(true) {
+        PG_draw_pixel_add(buffer, &run, x0, y0, color);
+        if(x0 == x1 && y0 == y1) {
+            break;
+        }
+        int error2 = error * 2;
+        if(error2 >= dy) {
+            error += dy;
+            x0 += step_x;
+        }
+        if(error2 <= dx) {
+            error += dx;
+            y0 += step_y;
+        }
+    }
+    PG_draw_pixel_flush(buffer, &run, color);
 }
 
-void PG_lcd_select_chip(struct PG_lcd_t *lcd, int chip)
+// 반지름 r인 원판에서 중심으로부터 dx column의 반높이. 원판 밖이면 -1
+// x^2 + y^2 <= r^2 + r 인 pixel을 원판으로 본다. 작은 원도 둥글게 나온다
+// guess가 0 이상이면 거기서부터 맞춰 간다. 이웃 column 높이를 주면 몇 step이면 끝난다
+static int PG_draw_circle_height(int r, int dx, int guess)
 {
-    chip = chip & 0b1;
-
-    if(chip == 0) {
-        PG_lcd_pin_on(lcd, lcd->pin_cs1);
-    } else {
-        PG_lcd_pin_on(lcd, lcd->pin_cs2);
+    int64_t limit = (int64_t)r * r + r - (int64_t)dx * dx;
+    if(dx > r || dx < -r || limit < 0) {
+        return -1;
+    }
+    int64_t h = guess;
+    if(guess < 0) {
+        // 정수 sqrt
+        int64_t bit = (int64_t)1 << 62;
+        while(bit > limit) {
+            bit >>= 2;
+        }
+        int64_t rest = limit;
+        h = 0;
+        while(bit != 0) {
+            if(rest >= h + bit) {
+                rest -= h + bit;
+                h = (h >> 1) + bit;
+            } else {
+                h >>= 1;
+            }
+            bit >>= 2;
+        }
+        return (int)h;
     }
+    while(h * h > limit) {
+        h--;
+    }
+    while((h + 1) * (h + 1) <= limit) {
+        h++;
+    }
+    return (int)h;
 }
 
-void PG_lcd_unselect_chip(struct PG_lcd_t *lcd)
+// 화면에 보이는 column의 원판 반높이와 테두리 시작 높이
+// column cx + dx (dx_begin <= dx <= dx_end)의 테두리는 반높이 [h_min, h] 구간이다
+// 이웃 column보다 높은 부분과 위아래 끝이 테두리
+struct PG_draw_circle_t {
+    int dx_begin;
+    int dx_end;
+    int height[PG_MAX_COLUMNS];
+    int h_min[PG_MAX_COLUMNS];
+};
+
+static bool PG_draw_circle_prepare(const struct PG_framebuffer_t *buffer, int cx, int r, struct PG_draw_circle_t *circle)
 {
-    PG_lcd_pin_off(lcd, lcd->pin_cs1);
-    PG_lcd_pin_off(lcd, lcd->pin_cs2);
+    if(r < 0) {
+        return false;
+    }
+    circle->dx_begin = (-r > -cx) ? -r : -cx;
+    circle->dx_end = (r < buffer->columns - 1 - cx) ? r : buffer->columns - 1 - cx;
+    if(circle->dx_begin > circle->dx_end) {
+        return false;
+    }
+    int left = PG_draw_circle_height(r, circle->dx_begin - 1, -1);
+    int h = PG_draw_circle_height(r, circle->dx_begin, -1);
+    for(int dx = circle->dx_begin ; dx <= circle->dx_end ; ++dx) {
+        int right = PG_draw_circle_height(r, dx + 1, (h > 0) ? h : 0);
+        int neighbor = (left < right) ? left : right;
+        int i = dx - circle->dx_begin;
+        circle->height[i] = h;
+        circle->h_min[i] = (neighbor + 1 < h) ? neighbor + 1 : h;
+        left = h;
+        h = right;
+    }
+    return true;
 }
 
-void PG_lcd_write_data_bit(struct PG_lcd_t *lcd, uint8_t data)
+static void PG_draw_circle_columns(struct PG_framebuffer_t *buffer, int cx, int cy, int r, bool fill, PG_color_t color)
 {
-    uint8_t data_pin_table[DATA_PIN_COUNT];
-    PG_lcd_fill_data_pin(lcd, data_pin_table);
-
-    for(int i = 0 ; i < 8 ; ++i) {
-        uint8_t pin = data_pin_table[i];
-        uint8_t mask = 1 << i;
-        if(data & mask) {
-            PG_lcd_pin_on(lcd, pin);
+    assert(color >= 0 && color < PG_COLOR_MAX_COUNT);
+    struct PG_draw_circle_t circle;
+    if(!PG_draw_circle_prepare(buffer, cx, r, &circle)) {
+        return;
+    }
+    for(int dx = circle.dx_begin ; dx <= circle.dx_end ; ++dx) {
+        int h = circle.height[dx - circle.dx_begin];
+        int h_min = fill ? 0 : circle.h_min[dx - circle.dx_begin];
+        if(h_min == 0) {
+            PG_draw_column_span(buffer, cx + dx, cy - h, cy + h + 1, color);
         } else {
-            PG_lcd_pin_off(lcd, pin);
+            PG_draw_column_span(buffer, cx + dx, cy - h, cy - h_min + 1, color);
+            PG_draw_column_span(buffer, cx + dx, cy + h_min, cy + h + 1, color);
         }
     }
+    int64_t top = (int64_t)cy - r;
+    int64_t bottom = (int64_t)cy + r + 1;
+    if(top < 0) { top = 0; }
+    if(bottom > PG_ROWS) { bottom = PG_ROWS; }
+    PG_framebuffer_mark_dirty(buffer, cx + circle.dx_begin, (int)top, circle.dx_end - circle.dx_begin + 1, (int)(bottom - top));
 }
 
-// 최대 60 fps로 제한하는 목적
-void PG_lcd_render_begin(struct PG_lcd_t *lcd)
+void PG_framebuffer_draw_circle(struct PG_framebuffer_t *buffer, int cx, int cy, int r, PG_color_t color)
 {
-    clock_gettime(CLOCK_MONOTONIC, &lcd->render_begin_tspec);
+    PG_draw_circle_columns(buffer, cx, cy, r, false, color);
 }
 
-void PG_lcd_render_end(struct PG_lcd_t *lcd)
+void PG_framebuffer_fill_circle(struct PG_framebuffer_t *buffer, int cx, int cy, int r, PG_color_t color)
 {
-    struct timespec lcd_render_end_tspec;
-    clock_gettime(CLOCK_MONOTONIC, &lcd_render_end_tspec);
-
-    struct timespec diff = PG_timespec_subtract(&lcd_render_end_tspec, &lcd->render_begin_tspec);
-    int milli = (diff.tv_sec * 1000) + (diff.tv_nsec / 1000 / 1000);
+    PG_draw_circle_columns(buffer, cx, cy, r, true, color);
+}
 
-    const int MAX_FPS = 60;
-    int target_milli = (int)(1000.0 / MAX_FPS);
-    if(milli < target_milli) {
-#ifdef __arm__
-        int sleep_milli = target_milli - milli - 1;
-        usleep(sleep_milli * 1000);
-#else
-        usleep(1);
-#endif
+// 각도의 방향 vector * DRAW_SIN_SCALE. y는 위쪽이 +
+static void PG_draw_angle_vector(int degree, int64_t *x, int64_t *y)
+{
+    degree %= 360;
+    if(degree < 0) {
+        degree += 360;
+    }
+    int quadrant = degree / 90;
+    int rest = degree % 90;
+    int64_t s = DRAW_SIN_TABLE[rest];
+    int64_t c = DRAW_SIN_TABLE[90 - rest];
+    switch(quadrant) {
+        case 0: *x = c; *y = s; break;
+        case 1: *x = -s; *y = c; break;
+        case 2: *x = -c; *y = -s; break;
+        default: *x = s; *y = -c; break;
     }
-
-    // update fps
-    fps_counter_update(&g_fps_counter);
 }
 
-void PG_lcd_commit_buffer(struct PG_lcd_t *lcd)
+void PG_framebuffer_draw_arc(struct PG_framebuffer_t *buffer, int cx, int cy, int r, int start_degree, int end_degree, PG_color_t color)
 {
-    PG_lcd_render_begin(lcd);
-    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
-        PG_lcd_select_chip(lcd, chip);
+    assert(color >= 0 && color < PG_COLOR_MAX_COUNT);
+    if(r < 0) {
+        return;
+    }
+    if(end_degree - start_degree >= 360 || start_degree - end_degree >= 360) {
+        PG_framebuffer_draw_circle(buffer, cx, cy, r, color);
+        return;
+    }
+    int sweep = ((end_degree - start_degree) % 360 + 360) % 360;
+    int64_t start_x, start_y, end_x, end_y;
+    PG_draw_angle_vector(start_degree, &start_x, &start_y);
+    PG_draw_angle_vector(end_degree, &end_x, &end_y);
 
-        for(int page = 0 ; page < lcd->pages ; ++page) {
-            PG_lcd_set_page(lcd, page);
-            PG_lcd_set_column(lcd, 0);
+    // 원 테두리 pixel 중 start에서 반시계 방향으로 end까지 사이에 있는 것만
+    // 같은 column의 pixel은 page마다 byte 하나로 모은다
+    struct PG_draw_circle_t circle;
+    if(!PG_draw_circle_prepare(buffer, cx, r, &circle)) {
+        return;
+    }
+    struct PG_draw_pixel_run_t run = { 0, 0, 0 };
+    for(int dx = circle.dx_begin ; dx <= circle.dx_end ; ++dx) {
+        int h = circle.height[dx - circle.dx_begin];
+        int h_min = circle.h_min[dx - circle.dx_begin];
+        // 위쪽 [cy - h, cy - h_min], 아래쪽 [cy + h_min, cy + h]. h_min = 0 이면 한 구간
+        int run_begin[2] = { cy - h, cy + h_min };
+        int run_end[2] = { cy - h_min, cy + h };
+        int run_count = (h_min == 0) ? 1 : 2;
+        if(h_min == 0) {
+            run_end[0] = cy + h;
+        }
+        for(int k = 0 ; k < run_count ; ++k) {
+            int y_begin = (run_begin[k] > 0) ? run_begin[k] : 0;
+            int y_end = (run_end[k] < PG_ROWS - 1) ? run_end[k] : PG_ROWS - 1;
+            for(int y = y_begin ; y <= y_end ; ++y) {
+                int64_t dy = cy - y;
+                int64_t start_cross = start_x * dy - start_y * dx;
+                int64_t end_cross = dx * end_y - dy * end_x;
+                bool inside;
+                if(sweep <= 180) {
+                    inside = start_cross >= 0 && end_cross >= 0;
+                } else {
+                    inside = !(start_cross < 0 && end_cross < 0);
+                }
+                if(inside) {
+                    PG_draw_pixel_add(buffer, &run, cx + dx, y, color);
+                }
+            }
+        }
+    }
+    PG_draw_pixel_flush(buffer, &run, color);
+}
 
-            const int chip_columns = PG_COLUMNS / PG_CHIPS;
-            for(int column = 0 ; column < chip_columns ; ++column) {
-                PG_lcd_pin_on(lcd, lcd->pin_rs);
+// glyph cache
+// font5x8 glyph를 row offset 8가지로 미리 밀어둔다. [shift][glyph][column]
+// upper는 glyph 윗부분이 들어갈 page, lower는 그 아래 page에 OR할 byte
+// column은 8칸으로 맞춰서 glyph 하나가 8byte 경계에 있다
+#define GLYPH_WIDTH 5
+#define GLYPH_MARGIN 1
+#define GLYPH_RENDER_WIDTH (GLYPH_WIDTH + GLYPH_MARGIN)
+#define GLYPH_OFFSET 0x20
+#define GLYPH_COUNT ((int)(sizeof(font5x8) / GLYPH_WIDTH))
+#define GLYPH_STRIDE 8
 
-                uint8_t data = lcd->buffer.data[PG_BUFFER_INDEX(page, chip * chip_columns + column)];
-                PG_lcd_write_data_bit(lcd, data);
-                lcd->pulse(lcd);
+struct PG_glyph_cache_t {
+    uint8_t upper[8][GLYPH_COUNT][GLYPH_STRIDE];
+    uint8_t lower[8][GLYPH_COUNT][GLYPH_STRIDE];
+};
+static struct PG_glyph_cache_t glyph_cache;
+static pthread_once_t glyph_cache_once = PTHREAD_ONCE_INIT;
 
-                PG_lcd_pin_off(lcd, lcd->pin_rs);
+static void PG_glyph_cache_build(void)
+{
+    for(int shift = 0 ; shift < 8 ; ++shift) {
+        for(int glyph = 0 ; glyph < GLYPH_COUNT ; ++glyph) {
+            for(int i = 0 ; i < GLYPH_WIDTH ; ++i) {
+                uint8_t line = font5x8[glyph * GLYPH_WIDTH + i];
+                glyph_cache.upper[shift][glyph][i] = line << shift;
+                glyph_cache.lower[shift][glyph][i] = shift ? (line >> (8 - shift)) : 0;
             }
         }
-        PG_lcd_unselect_chip(lcd);
     }
-    lcd->frame_end_callback(lcd);
-    PG_lcd_render_end(lcd);
 }
 
-void PG_lcd_render_buffer(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer)
+// font에 없는 문자는 '?'로 그린다
+static int PG_glyph_index(char character)
 {
-    PG_lcd_render_begin(lcd);
+    int glyph = (unsigned char)character - GLYPH_OFFSET;
+    if(glyph < 0 || glyph >= GLYPH_COUNT) {
+        glyph = '?' - GLYPH_OFFSET;
+    }
+    return glyph;
+}
 
-    // diff가 존재하는 page/chip 찾아내기
-    // 해당 page/chip에서만 변경을 수행하면 명령을 줄일수 있다
-    int diff_list[lcd->pages * lcd->chips];
-    memset(diff_list, -1, sizeof(diff_list));
+void PG_framebuffer_print_string(struct PG_framebuffer_t *buffer, const char *str)
+{
+    pthread_once(&glyph_cache_once, PG_glyph_cache_build);
 
-    int chip_columns = lcd->columns / lcd->chips;
-    int diff_list_idx = 0;
-    for(int chip = 0 ; chip < lcd->chips ; ++chip) {
-        for(int page = 0 ; page < lcd->pages ; ++page) {
-            for(int column = 0 ; column < chip_columns ; ++column) {
-                int idx = PG_BUFFER_INDEX(page, chip * chip_columns + column);
-                uint8_t prev_data = lcd->buffer.data[idx];
-                uint8_t next_data = buffer->data[idx];
-                if(prev_data == next_data) {
-                    continue;
-                }
+    int length = strlen(str);
+    int begin_x = buffer->curr_x;
+    int cursor_x = begin_x;
+    int cursor_y = buffer->curr_y;
+    int columns = buffer->columns;
 
-                diff_list[diff_list_idx] = chip * lcd->pages + page;
-                diff_list_idx++;
-                break;
+    // 문자열 동안 row 위치는 같으므로 page와 shift는 한번만 구한다
+    int upper_page = (cursor_y >= 0) ? (cursor_y / 8) : -((7 - cursor_y) / 8);
+    int shift = cursor_y - upper_page * 8;
+    int lower_page = upper_page + 1;
+    uint8_t *upper_row = (upper_page >= 0 && upper_page < PG_PAGES) ? &buffer->data[PG_BUFFER_INDEX(upper_page, 0)] : NULL;
+    uint8_t *lower_row = (shift != 0 && lower_page >= 0 && lower_page < PG_PAGES) ? &buffer->data[PG_BUFFER_INDEX(lower_page, 0)] : NULL;
+    // 화면 위나 아래로 벗어났으면 cursor만 움직인다
+    int draw_length = (upper_row != NULL || lower_row != NULL) ? length : 0;
+
+    int character_idx = 0;
+    // 왼쪽 밖에 있는 문자는 건너뛴다
+    if(cursor_x <= -GLYPH_RENDER_WIDTH) {
+        int skip = -cursor_x / GLYPH_RENDER_WIDTH;
+        if(skip > draw_length) { skip = draw_length; }
+        character_idx = skip;
+        cursor_x += skip * GLYPH_RENDER_WIDTH;
+    }
+    for( ; character_idx < draw_length && cursor_x < columns ; ++character_idx) {
+        int glyph = PG_glyph_index(str[character_idx]);
+        // 보이는 column 구간 [begin, end)
+        int begin = (cursor_x < 0) ? -cursor_x : 0;
+        int end = (columns - cursor_x < GLYPH_WIDTH) ? (columns - cursor_x) : GLYPH_WIDTH;
+        const uint8_t *upper_glyph = glyph_cache.upper[shift][glyph];
+        const uint8_t *lower_glyph = glyph_cache.lower[shift][glyph];
+        if(begin == 0 && end == GLYPH_WIDTH) {
+            // 안 잘린 glyph는 길이가 상수라 compiler가 펼친다
+            if(shift == 0) {
+                memcpy(&upper_row[cursor_x], upper_glyph, GLYPH_WIDTH);
+            } else {
+                if(upper_row != NULL) {
+                    for(int i = 0 ; i < GLYPH_WIDTH ; ++i) {
+                        upper_row[cursor_x + i] |= upper_glyph[i];
+                    }
+                }
+                if(lower_row != NULL) {
+                    for(int i = 0 ; i < GLYPH_WIDTH ; ++i) {
+                        lower_row[cursor_x + i] |= lower_glyph[i];
+                    }
+                }
+            }
+        } else if(shift == 0) {
+            // 페이지 단위에 맞게 떨어지면 glyph를 통째로 복사한다
+            if(begin < end) {
+                memcpy(&upper_row[cursor_x + begin], &upper_glyph[begin], end - begin);
+            }
+        } else {
+            if(upper_row != NULL) {
+                for(int i = begin ; i < end ; ++i) {
+                    upper_row[cursor_x + i] |= upper_glyph[i];
+                }
+            }
+            if(lower_row != NULL) {
+                for(int i = begin ; i < end ; ++i) {
+                    lower_row[cursor_x + i] |= lower_glyph[i];
+                }
             }
         }
+        cursor_x += GLYPH_RENDER_WIDTH;
     }
+    // 잘려서 그리지 않은 문자도 cursor는 움직인다
+    cursor_x = begin_x + length * GLYPH_RENDER_WIDTH;
 
-    int latest_chip = -1;
-    for(int diff_idx = 0 ; diff_idx < diff_list_idx ; ++diff_idx) {
-        int chip = diff_list[diff_idx] / lcd->pages;
-        int page = diff_list[diff_idx] % lcd->pages;
+    int dirty_end = (cursor_x < columns) ? cursor_x : columns;
+    PG_framebuffer_mark_dirty(buffer, begin_x, cursor_y, dirty_end - begin_x, 8);
 
-        PG_lcd_select_chip(lcd, chip);
-        PG_lcd_set_page(lcd, page);
-        PG_lcd_set_column(lcd, 0);
-
-        int latest_column = -1;
-        for(int column = 0 ; column < chip_columns ; ++column) {
-            int idx = PG_BUFFER_INDEX(page, chip * chip_columns + column);
-            uint8_t prev_data = lcd->buffer.data[idx];
-            uint8_t next_data = buffer->data[idx];
-            if(prev_data == next_data) {
-                continue;
-            }
+    buffer->curr_x = cursor_x;
+    buffer->curr_y = cursor_y;
+}
 
-            if(latest_column + 1 != column) {
-                PG_lcd_set_column(lcd, column);
-                latest_column = column;
-            }
+// packed font
+static const struct PG_font_glyph_t *PG_font_search(const struct PG_font_glyph_t *glyph_list, uint32_t glyph_count, uint32_t codepoint)
+{
+    uint32_t low = 0;
+    uint32_t high = glyph_count;
+    while(low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if(glyph_list[mid].codepoint < codepoint) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if(low < glyph_count && glyph_list[low].codepoint == codepoint) {
+        return &glyph_list[low];
+    }
+    return NULL;
+}
+
+int PG_font_open(struct PG_font_t *font, const char *path)
+{
+    memset(font, 0, sizeof(*font));
+    font->fd = -1;
 
-            PG_lcd_pin_on(lcd, lcd->pin_rs);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "font: cannot open %s\n", path);
+        return 1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct PG_font_file_header_t)) {
+        fprintf(stderr, "font: %s is too small\n", path);
+        close(fd);
+        return 1;
+    }
+    size_t map_size = st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        fprintf(stderr, "font: cannot mmap %s\n", path);
+        close(fd);
+        return 1;
+    }
+    font->map = map;
+    font->map_size = map_size;
+    font->fd = fd;
 
-            PG_lcd_write_data_bit(lcd, next_data);
-            lcd->pulse(lcd);
+    // header와 index만 검사한다. bitmap page는 그릴때 처음 읽힌다
+    // 크기는 더하지 않고 남은 크기와 비교한다. 32bit size_t에서 overflow 방지
+    const struct PG_font_file_header_t *header = map;
+    size_t body_size = map_size - sizeof(*header);
+    size_t index_size = 0;
+    bool ok = memcmp(header->magic, PG_FONT_MAGIC, sizeof(header->magic)) == 0;
+    ok = ok && header->version == PG_FONT_VERSION;
+    ok = ok && header->glyph_size == sizeof(struct PG_font_glyph_t);
+    ok = ok && header->height > 0 && header->glyph_count > 0;
+    ok = ok && header->glyph_count <= body_size / sizeof(struct PG_font_glyph_t);
+    if(ok) {
+        index_size = (size_t)header->glyph_count * sizeof(struct PG_font_glyph_t);
+        ok = header->bitmap_size <= body_size - index_size;
+    }
+    if(!ok) {
+        fprintf(stderr, "font: %s is not a packed font\n", path);
+        PG_font_close(font);
+        return 1;
+    }
+    font->height = header->height;
+    font->ascent = header->ascent;
+    font->glyph_count = header->glyph_count;
+    font->glyph_list = (const struct PG_font_glyph_t *)((const uint8_t *)map + sizeof(*header));
+    font->bitmap = (const uint8_t *)map + sizeof(*header) + index_size;
 
-            PG_lcd_pin_off(lcd, lcd->pin_rs);
+    for(uint32_t i = 0 ; i < font->glyph_count ; ++i) {
+        const struct PG_font_glyph_t *glyph = &font->glyph_list[i];
+        uint64_t glyph_end = (uint64_t)glyph->bitmap_offset + ((glyph->height + 7) / 8) * glyph->width;
+        bool sorted = (i == 0) || font->glyph_list[i - 1].codepoint < glyph->codepoint;
+        if(!sorted || glyph_end > header->bitmap_size) {
+            fprintf(stderr, "font: %s has a broken glyph index\n", path);
+            PG_font_close(font);
+            return 1;
         }
-        PG_lcd_unselect_chip(lcd);
     }
-    memcpy(&lcd->buffer, buffer, sizeof(struct PG_framebuffer_t));
 
-    lcd->frame_end_callback(lcd);
-    PG_lcd_render_end(lcd);
+    font->default_glyph = PG_font_find_glyph(font, header->default_codepoint);
+    if(font->default_glyph == NULL) {
+        font->default_glyph = PG_font_find_glyph(font, PG_FONT_REPLACEMENT);
+    }
+    if(font->default_glyph == NULL) {
+        font->default_glyph = PG_font_find_glyph(font, '?');
+    }
+    return 0;
 }
 
-// framebuffer impl
-void PG_framebuffer_clear(struct PG_framebuffer_t *buffer)
+void PG_font_close(struct PG_font_t *font)
 {
-    memset(buffer, 0, sizeof(*buffer));
-    buffer->width = PG_COLUMNS;
-    buffer->height = PG_PAGES;
-    buffer->curr_x = 0;
-    buffer->curr_y = 0;
+    if(font->map != NULL) {
+        munmap((void *)font->map, font->map_size);
+    }
+    if(font->fd >= 0) {
+        close(font->fd);
+    }
+    memset(font, 0, sizeof(*font));
+    font->fd = -1;
 }
 
-void PG_framebuffer_write_sample_pattern(struct PG_framebuffer_t *buffer)
+const struct PG_font_glyph_t *PG_font_find_glyph(const struct PG_font_t *font, uint32_t codepoint)
 {
-    for(int page = 0 ; page < PG_PAGES ; ++page) {
-        for(int column = 0 ; column < PG_COLUMNS ; ++column) {
-            uint8_t data = (column % 2) ? 0b10101010 : 0b01010101;
-            buffer->data[PG_BUFFER_INDEX(page, column)] = data;
-        }
-    }
+    return PG_font_search(font->glyph_list, font->glyph_count, codepoint);
 }
 
-void PG_framebuffer_draw_bitmap(struct PG_framebuffer_t *buffer, PG_image_t data)
+uint32_t PG_utf8_decode(const char **str)
 {
-    int width = data[0];
-    int height = data[1];
-    buffer->width = width;
-    buffer->height = height;
-    for(int page = 0 ; page < (height / 8) ; ++page) {
-        for(int column = 0 ; column < width ; ++column) {
-            uint8_t elem = data[page * width + column + 2];
-            buffer->data[PG_BUFFER_INDEX(page, column)] = elem;
+    const uint8_t *p = (const uint8_t *)*str;
+    uint32_t lead = p[0];
+    *str += 1;
+    if(lead < 0x80) {
+        return lead;
+    }
+
+    int length;
+    uint32_t codepoint;
+    uint32_t min_codepoint;
+    if((lead & 0xE0) == 0xC0) {
+        length = 2;
+        codepoint = lead & 0x1F;
+        min_codepoint = 0x80;
+    } else if((lead & 0xF0) == 0xE0) {
+        length = 3;
+        codepoint = lead & 0x0F;
+        min_codepoint = 0x800;
+    } else if((lead & 0xF8) == 0xF0) {
+        length = 4;
+        codepoint = lead & 0x07;
+        min_codepoint = 0x10000;
+    } else {
+        return PG_FONT_REPLACEMENT;
+    }
+    for(int i = 1 ; i < length ; ++i) {
+        // '\0'도 여기서 걸린다
+        if((p[i] & 0xC0) != 0x80) {
+            return PG_FONT_REPLACEMENT;
         }
+        codepoint = (codepoint << 6) | (p[i] & 0x3F);
     }
+    // overlong, surrogate, 범위 밖
+    if(codepoint < min_codepoint || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return PG_FONT_REPLACEMENT;
+    }
+    *str += length - 1;
+    return codepoint;
 }
-void PG_framebuffer_cursor_to_xy(struct PG_framebuffer_t *buffer, int x, int y)
+
+static const struct PG_font_glyph_t *PG_font_glyph_or_default(const struct PG_font_t *font, uint32_t codepoint)
 {
-    buffer->curr_x = x;
-    buffer->curr_y = y;
+    const struct PG_font_glyph_t *glyph = PG_font_find_glyph(font, codepoint);
+    return (glyph != NULL) ? glyph : font->default_glyph;
 }
-void PG_framebuffer_overlay_assign(struct PG_framebuffer_t *dst, struct PG_framebuffer_t *src, int x, int y)
+
+int PG_font_text_width(const struct PG_font_t *font, const char *str)
 {
-    for(int src_page = 0 ; src_page < (src->height / 8 ) ; ++src_page) {
-        for(int src_x = 0 ; src_x < src->width ; ++src_x) {
-            int src_idx = PG_BUFFER_INDEX(src_page, src_x);
-            uint8_t src_elem = src->data[src_idx];
-            
-            int dst_x = src_x + x;
-            if(dst_x >= PG_COLUMNS) { break; }
-            
-            if(y % 8 == 0) {
-                // 페이지 단위에 맞게 떨어지면 처리가 단순하다
-                int dst_page = src_page + (y / 8);
-                if(dst_page >= PG_PAGES) { break; }
-                int dst_idx = PG_BUFFER_INDEX(dst_page, dst_x);
-                dst->data[dst_idx] = src_elem;
-                
-            } else {
-                int dst_upper_page = src_page + (y / 8);
-                int dst_lower_page = dst_upper_page + 1;
-                
-                int lower_bits = y % 8;
-                int upper_bits = 8 - lower_bits;
-                
-                uint8_t upper_elem = src_elem << lower_bits;
-                uint8_t lower_elem = src_elem >> upper_bits;
-                
-                // render upper
-                if(dst_upper_page < PG_PAGES) {
-                    int upper_idx = PG_BUFFER_INDEX(dst_upper_page, dst_x);
-                    uint8_t prev_elem = dst->data[upper_idx];
-                    uint8_t next_elem = prev_elem | upper_elem;
-                    dst->data[upper_idx] = next_elem;
-                }
-                
-                // render lower
-                if(dst_lower_page < PG_PAGES) {
-                    int lower_idx = PG_BUFFER_INDEX(dst_lower_page, dst_x);
-                    uint8_t prev_elem = dst->data[lower_idx];
-                    uint8_t next_elem = prev_elem | lower_elem;
-                    dst->data[lower_idx] = next_elem;
-                } 
+    int width = 0;
+    while(*str != '\0') {
+        const struct PG_font_glyph_t *glyph = PG_font_glyph_or_default(font, PG_utf8_decode(&str));
+        width += (glyph != NULL) ? glyph->advance : 0;
+    }
+    return width;
+}
+
+// glyph bitmap을 (x, y)에 OR한다. glyph page 하나가 화면 page 두개에 걸친다
+static void PG_framebuffer_draw_glyph(struct PG_framebuffer_t *buffer, const uint8_t *bitmap, int width, int height, int x, int y)
+{
+    int columns = buffer->columns;
+    if(x >= columns || x + width <= 0 || y >= PG_ROWS || y + height <= 0) {
+        return;
+    }
+    int begin = (x < 0) ? -x : 0;
+    int end = (columns - x < width) ? (columns - x) : width;
+    int glyph_pages = (height + 7) / 8;
+    for(int glyph_page = 0 ; glyph_page < glyph_pages ; ++glyph_page) {
+        const uint8_t *src = &bitmap[glyph_page * width];
+        int row_y = y + glyph_page * 8;
+        int upper_page = (row_y >= 0) ? (row_y / 8) : -((7 - row_y) / 8);
+        int shift = row_y - upper_page * 8;
+        if(upper_page >= 0 && upper_page < PG_PAGES) {
+            uint8_t *dst = &buffer->data[PG_BUFFER_INDEX(upper_page, 0)];
+            for(int i = begin ; i < end ; ++i) {
+                dst[x + i] |= (uint8_t)(src[i] << shift);
+            }
+        }
+        if(shift != 0 && upper_page + 1 >= 0 && upper_page + 1 < PG_PAGES) {
+            uint8_t *dst = &buffer->data[PG_BUFFER_INDEX(upper_page + 1, 0)];
+            for(int i = begin ; i < end ; ++i) {
+                dst[x + i] |= src[i] >> (8 - shift);
             }
         }
     }
 }
 
-void PG_framebuffer_print_string(struct PG_framebuffer_t *buffer, const char *str)
+void PG_framebuffer_print_utf8(struct PG_framebuffer_t *buffer, const struct PG_font_t *font, const char *str)
 {
-    const char *font_data = font5x8;
-    
-    const int FONT_MARGIN = 1;
-    const int FONT_WIDTH = 5;
-    const int FONT_RENDER_WIDTH = FONT_WIDTH + FONT_MARGIN;
-    const int FONT_OFFSET = 0x20;
-    
-    int length = strlen(str);
     int cursor_x = buffer->curr_x;
     int cursor_y = buffer->curr_y;
-    
-    for(int character_idx = 0 ; character_idx < length ; ++character_idx) {
-        char character = str[character_idx] - FONT_OFFSET;
-        
-        if(cursor_y % 8 == 0) {
-            int page = cursor_y / 8;
-            for(int i = 0 ; i < FONT_WIDTH ; ++i) {
-                uint8_t line = font_data[character * FONT_WIDTH + i];
-                buffer->data[PG_BUFFER_INDEX(page, cursor_x)] = line;
-                cursor_x++;
-            }
-            cursor_x += FONT_MARGIN;
-            
-        } else {
-            int upper_page = cursor_y / 8;
-            int lower_page = upper_page + 1;
-            
-            int lower_bits = cursor_y % 8;
-            int upper_bits = 8 - lower_bits;
 
-            for(int i = 0 ; i < FONT_WIDTH ; ++i) {
-                uint8_t line = font_data[character * FONT_WIDTH + i];
-                uint8_t upper_elem = line << lower_bits;
-                uint8_t lower_elem = line >> upper_bits;
-            
-                buffer->data[PG_BUFFER_INDEX(upper_page, cursor_x)] |= upper_elem;
-                buffer->data[PG_BUFFER_INDEX(lower_page, cursor_x)] |= lower_elem;
-                cursor_x++;
-            }
-            cursor_x += FONT_MARGIN;
+    // glyph가 line 밖으로 나갈수 있으므로 실제로 그린 범위를 dirty로 남긴다
+    int dirty_left = cursor_x;
+    int dirty_right = cursor_x;
+    int dirty_top = cursor_y;
+    int dirty_bottom = cursor_y;
+    while(*str != '\0') {
+        const struct PG_font_glyph_t *glyph = PG_font_glyph_or_default(font, PG_utf8_decode(&str));
+        if(glyph == NULL) {
+            continue;
+        }
+        int x = cursor_x + glyph->x_offset;
+        int y = cursor_y + glyph->y_offset;
+        if(glyph->width > 0 && glyph->height > 0) {
+            PG_framebuffer_draw_glyph(buffer, &font->bitmap[glyph->bitmap_offset], glyph->width, glyph->height, x, y);
+            if(x < dirty_left) { dirty_left = x; }
+            if(x + glyph->width > dirty_right) { dirty_right = x + glyph->width; }
+            if(y < dirty_top) { dirty_top = y; }
+            if(y + glyph->height > dirty_bottom) { dirty_bottom = y + glyph->height; }
         }
+        cursor_x += glyph->advance;
     }
-    
+    PG_framebuffer_mark_dirty(buffer, dirty_left, dirty_top, dirty_right - dirty_left, dirty_bottom - dirty_top);
+
     buffer->curr_x = cursor_x;
     buffer->curr_y = cursor_y;
 }
@@ -980,7 +4472,7 @@ void PG_framebuffer_write_test(struct PG_framebuffer_t *buffer)
     const int FONT_WIDTH = 5;
     const int FONT_RENDER_WIDTH = FONT_WIDTH + 1;
     const int CHARACTER_COUNT = sizeof(font5x8) / (sizeof(font5x8[0]) * FONT_WIDTH);
-    const int COUNT_CHARACTER_IN_ROW = PG_COLUMNS / FONT_RENDER_WIDTH;
+    const int COUNT_CHARACTER_IN_ROW = PG_DEFAULT_COLUMNS / FONT_RENDER_WIDTH;
 
     for(int character = 0 ; character < CHARACTER_COUNT ; ++character) {
         int page = character / COUNT_CHARACTER_IN_ROW;
@@ -1042,7 +4534,7 @@ void PG_framebuffer_write_test(struct PG_framebuffer_t *buffer)
                 int page_inner_y = y % 8;
                 
                 if(page >= PG_PAGES) break;
-                if(column >= PG_COLUMNS) break;
+                if(column >= PG_DEFAULT_COLUMNS) break;
                 
                 //uint8_t mask = (1 << (8 - page_inner_y - 1));
                 uint8_t mask = (1 << page_inner_y);
@@ -1054,3 +4546,160 @@ void PG_framebuffer_write_test(struct PG_framebuffer_t *buffer)
     frame++;
     */
 }
+
+// text console
+#define CONSOLE_FONT_WIDTH 5
+#define CONSOLE_FONT_OFFSET 0x20
+#define CONSOLE_FONT_GLYPHS ((int)(sizeof(font5x8) / CONSOLE_FONT_WIDTH))
+#define CONSOLE_ROW_MASK(console) (~0ULL >> (64 - (console)->columns))
+
+static char *PG_console_line(struct PG_console_t *console, int back)
+{
+    int idx = (console->line_head - back + PG_CONSOLE_SCROLLBACK) % PG_CONSOLE_SCROLLBACK;
+    return console->line_ring[idx];
+}
+
+static void PG_console_mark_all(struct PG_console_t *console)
+{
+    for(int row = 0 ; row < PG_CONSOLE_ROWS ; ++row) {
+        console->cell_dirty[row] = CONSOLE_ROW_MASK(console);
+    }
+    console->pending_scroll = 0;
+}
+
+void PG_console_initialize(struct PG_console_t *console, struct PG_lcd_t *lcd)
+{
+    memset(console, 0, sizeof(*console));
+    console->lcd = lcd;
+    console->columns = lcd->columns / PG_CONSOLE_CELL_WIDTH;
+    PG_framebuffer_initialize(&console->buffer, lcd->columns);
+    memset(console->line_ring, ' ', sizeof(console->line_ring));
+    console->line_count = 1;
+    PG_console_mark_all(console);
+}
+
+static void PG_console_newline(struct PG_console_t *console)
+{
+    console->line_head = (console->line_head + 1) % PG_CONSOLE_SCROLLBACK;
+    memset(PG_console_line(console, 0), ' ', PG_CONSOLE_MAX_COLUMNS);
+    if(console->line_count < PG_CONSOLE_SCROLLBACK) {
+        console->line_count++;
+    }
+    console->cursor_column = 0;
+
+    // 예전 line을 보고 있으면 view를 그대로 둔다
+    if(console->view_offset > 0) {
+        if(console->view_offset + PG_CONSOLE_ROWS < console->line_count) {
+            console->view_offset++;
+        } else {
+            PG_console_mark_all(console);
+        }
+        return;
+    }
+
+    if(console->cursor_row < PG_CONSOLE_ROWS - 1) {
+        console->cursor_row++;
+        return;
+    }
+    // 화면이 찼으면 한 줄 올린다. 아래 row는 새로 그린다
+    memmove(&console->cell_dirty[0], &console->cell_dirty[1], sizeof(console->cell_dirty[0]) * (PG_CONSOLE_ROWS - 1));
+    console->cell_dirty[PG_CONSOLE_ROWS - 1] = CONSOLE_ROW_MASK(console);
+    console->pending_scroll++;
+}
+
+static void PG_console_put(struct PG_console_t *console, char character)
+{
+    if(console->cursor_column >= console->columns) {
+        PG_console_newline(console);
+    }
+    char *line = PG_console_line(console, 0);
+    if(line[console->cursor_column] != character) {
+        line[console->cursor_column] = character;
+        if(console->view_offset == 0) {
+            console->cell_dirty[console->cursor_row] |= 1ULL << console->cursor_column;
+        }
+    }
+    console->cursor_column++;
+}
+
+void PG_console_write(struct PG_console_t *console, const char *str, size_t length)
+{
+    for(size_t i = 0 ; i < length ; ++i) {
+        char character = str[i];
+        if(character == '\n') {
+            PG_console_newline(console);
+        } else if(character == '\r') {
+            console->cursor_column = 0;
+        } else if(character == '\t') {
+            do {
+                PG_console_put(console, ' ');
+            } while(console->cursor_column % PG_CONSOLE_TAB_WIDTH != 0 && console->cursor_column < console->columns);
+        } else {
+            int glyph = (unsigned char)character - CONSOLE_FONT_OFFSET;
+            if(glyph < 0 || glyph >= CONSOLE_FONT_GLYPHS) {
+                character = '?';
+            }
+            PG_console_put(console, character);
+        }
+    }
+}
+
+void PG_console_scroll_view(struct PG_console_t *console, int lines)
+{
+    // 화면을 다 채우지 못한 line까지는 올라갈 필요가 없다
+    int max_offset = console->line_count - 1 - console->cursor_row;
+    int view_offset = console->view_offset + lines;
+    if(view_offset > max_offset) { view_offset = max_offset; }
+    if(view_offset < 0) { view_offset = 0; }
+    if(view_offset == console->view_offset) {
+        return;
+    }
+    console->view_offset = view_offset;
+    PG_console_mark_all(console);
+}
+
+static void PG_console_draw_cell(struct PG_console_t *console, int row, int column, char character)
+{
+    int glyph = (unsigned char)character - CONSOLE_FONT_OFFSET;
+    int x = column * PG_CONSOLE_CELL_WIDTH;
+    uint8_t *dst = &console->buffer.data[PG_BUFFER_INDEX(row, x)];
+    for(int i = 0 ; i < CONSOLE_FONT_WIDTH ; ++i) {
+        dst[i] = font5x8[glyph * CONSOLE_FONT_WIDTH + i];
+    }
+    for(int i = CONSOLE_FONT_WIDTH ; i < PG_CONSOLE_CELL_WIDTH ; ++i) {
+        dst[i] = 0;
+    }
+    PG_framebuffer_dirty_span(&console->buffer, row, x, x + PG_CONSOLE_CELL_WIDTH);
+}
+
+void PG_console_flush(struct PG_console_t *console)
+{
+    struct PG_lcd_t *lcd = console->lcd;
+
+    // 새 line은 start line을 옮겨서 올리고 드러난 row만 그린다
+    // 화면 전체보다 많이 밀렸으면 어차피 다 다시 그린다
+    if(console->pending_scroll >= PG_CONSOLE_ROWS) {
+        PG_console_mark_all(console);
+    }
+    if(console->pending_scroll > 0) {
+        PG_lcd_scroll(lcd, &console->buffer, console->pending_scroll * 8);
+        console->pending_scroll = 0;
+    }
+
+    for(int row = 0 ; row < PG_CONSOLE_ROWS ; ++row) {
+        uint64_t dirty = console->cell_dirty[row];
+        if(dirty == 0) {
+            continue;
+        }
+        const char *line = PG_console_line(console, console->cursor_row - row + console->view_offset);
+        bool exist = (console->cursor_row - row + console->view_offset) < console->line_count;
+        while(dirty != 0) {
+            int column = __builtin_ctzll(dirty);
+            dirty &= dirty - 1;
+            PG_console_draw_cell(console, row, column, exist ? line[column] : ' ');
+        }
+        console->cell_dirty[row] = 0;
+    }
+    PG_lcd_render_buffer(lcd, &console->buffer);
+}
+
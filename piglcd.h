@@ -3,14 +3,42 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 // for timespec
 #include <time.h>
+#include <pthread.h>
 
+// KS0108 chip 하나 = 64x64. panel은 chip 1~4개를 옆으로 붙인다
 #define PG_ROWS 64
-#define PG_COLUMNS 128
 #define PG_PAGES (PG_ROWS / 8)
-#define PG_CHIPS 2
-#define PG_CHIP_COLUMNS (PG_COLUMNS / PG_CHIPS)
+#define PG_CHIP_COLUMNS 64
+#define PG_MAX_CHIPS 4
+#define PG_MAX_COLUMNS (PG_CHIP_COLUMNS * PG_MAX_CHIPS)
+// 기본 geometry, 128x64
+#define PG_DEFAULT_CHIPS 2
+#define PG_DEFAULT_COLUMNS (PG_CHIP_COLUMNS * PG_DEFAULT_CHIPS)
+
+// BCM GPIO register window (GPFSEL0..GPLEV0)
+#define PG_GPIOMEM_BLOCK_SIZE 4096
+// pin number -> BCM gpio lookup size
+#define PG_GPIOMEM_PIN_TABLE_SIZE 64
+// pin number는 uint8_t
+#define PG_PIN_SHADOW_SIZE 256
+// 연결하지 않은 pin (pin_rw 등)
+#define PG_PIN_NONE 0xFF
+
+// status read
+#define PG_STATUS_BUSY 0b10000000
+#define PG_STATUS_OFF 0b00100000
+#define PG_STATUS_RESET 0b00010000
+
+// chip 번호 대신 쓰면 CS를 모두 켜고 모든 chip에 같은 byte를 쓴다
+#define PG_CHIP_ALL (-2)
+
+// async render triple buffer
+#define PG_ASYNC_SLOTS 3
+#define PG_ASYNC_SLOT_MASK 0b011
+#define PG_ASYNC_FRESH 0b100
 
 typedef uint8_t* PG_image_t;
 typedef enum {
@@ -25,39 +53,263 @@ typedef enum {
     PG_BACKEND_GPIO,
     PG_BACKEND_GLFW,
     PG_BACKEND_DUMMY,
+    PG_BACKEND_GPIOMEM,
+    PG_BACKEND_EMU,
     PG_BACKEND_MAX_COUNT,
 } PG_backend_t;
 
+// data의 page 간격은 항상 PG_MAX_COLUMNS. columns 밖은 그리지 않는다
 struct PG_framebuffer_t {
-    uint8_t data[PG_PAGES * PG_COLUMNS];
+    uint8_t data[PG_PAGES * PG_MAX_COLUMNS];
+    uint16_t columns;
     
     int width;
     int height;
     int curr_x;
     int curr_y;
+    
+    // 마지막 render 이후 그린 column 구간 [begin, end), page마다 하나
+    // begin >= end 이면 깨끗하다
+    uint16_t dirty_begin[PG_PAGES];
+    uint16_t dirty_end[PG_PAGES];
 };
+// 지금 columns 폭 그대로 초기화. 처음 쓰는 buffer면 기본 geometry(PG_DEFAULT_COLUMNS)
 void PG_framebuffer_clear(struct PG_framebuffer_t *buffer);
+// columns 폭으로 초기화. 보통 lcd->columns를 넘긴다
+void PG_framebuffer_initialize(struct PG_framebuffer_t *buffer, int columns);
+// geometry는 두고 내용만 지운다
+void PG_framebuffer_erase(struct PG_framebuffer_t *buffer);
+// data를 직접 고쳤으면 그 영역을 알려줘야 render가 놓치지 않는다
+void PG_framebuffer_mark_dirty(struct PG_framebuffer_t *buffer, int x, int y, int w, int h);
+void PG_framebuffer_mark_all_dirty(struct PG_framebuffer_t *buffer);
 void PG_framebuffer_write_sample_pattern(struct PG_framebuffer_t *buffer);
 void PG_framebuffer_write_test(struct PG_framebuffer_t *buffer);
 
+// width/height를 그림 크기로 바꾼다. blit/overlay의 src 범위가 된다
 void PG_framebuffer_draw_bitmap(struct PG_framebuffer_t *buffer, PG_image_t data);
 void PG_framebuffer_cursor_to_xy(struct PG_framebuffer_t *buffer, int x, int y);
+// font5x8, 글자 폭 6. 화면 밖으로 나간 부분은 잘린다
+// y가 8의 배수면 덮어쓰고, 아니면 두 page에 걸쳐 OR한다
 void PG_framebuffer_print_string(struct PG_framebuffer_t *buffer, const char *str);
 
 
+// src의 (0, 0, width, height / 8 * 8) 영역을 (x, y)에 COPY blit
 void PG_framebuffer_overlay_assign(struct PG_framebuffer_t *dst, struct PG_framebuffer_t *src, int x, int y);
 
+// blit raster op. 영역 밖 pixel은 건드리지 않는다
+typedef enum {
+    PG_ROP_COPY,        // dst = src
+    PG_ROP_OR,          // dst |= src
+    PG_ROP_AND,         // dst &= src
+    PG_ROP_XOR,         // dst ^= src
+    PG_ROP_AND_NOT,     // dst &= ~src, src 모양으로 지운다
+    PG_ROP_MASKED,      // mask가 1인 pixel만 dst = src
+    PG_ROP_MAX_COUNT,
+} PG_rop_t;
+// src의 (src_x, src_y, w, h) 영역을 dst의 (dst_x, dst_y)에 그린다. 음수 좌표도 되고 양쪽 모두 잘린다
+// mask는 PG_ROP_MASKED일때만 쓰고 src와 같은 좌표계다. src == dst여도 된다
+void PG_framebuffer_blit(struct PG_framebuffer_t *dst, int dst_x, int dst_y,
+                         const struct PG_framebuffer_t *src, int src_x, int src_y, int w, int h,
+                         PG_rop_t rop, const struct PG_framebuffer_t *mask);
+
+// 도형 그리기. 화면 밖은 잘리고 그린 곳은 dirty가 된다
+typedef enum {
+    PG_COLOR_CLEAR,
+    PG_COLOR_SET,
+    PG_COLOR_INVERT,
+    PG_COLOR_MAX_COUNT,
+} PG_color_t;
+void PG_framebuffer_draw_hline(struct PG_framebuffer_t *buffer, int x, int y, int w, PG_color_t color);
+void PG_framebuffer_draw_vline(struct PG_framebuffer_t *buffer, int x, int y, int h, PG_color_t color);
+void PG_framebuffer_draw_rect(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, PG_color_t color);
+void PG_framebuffer_fill_rect(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, PG_color_t color);
+// pattern은 8x8 tile, byte 하나가 column 하나 (bit 0 = 위). 화면 좌표에 고정되어 이어 칠해도 맞는다
+// rop는 pattern을 src로 본다. PG_ROP_MASKED는 안된다
+void PG_framebuffer_fill_pattern(struct PG_framebuffer_t *buffer, int x, int y, int w, int h, const uint8_t pattern[8], PG_rop_t rop);
+// 양 끝 포함
+void PG_framebuffer_draw_line(struct PG_framebuffer_t *buffer, int x0, int y0, int x1, int y1, PG_color_t color);
+void PG_framebuffer_draw_circle(struct PG_framebuffer_t *buffer, int cx, int cy, int r, PG_color_t color);
+void PG_framebuffer_fill_circle(struct PG_framebuffer_t *buffer, int cx, int cy, int r, PG_color_t color);
+// 각도는 도 단위, 0 = 오른쪽, 반시계 방향. start에서 end까지 그린다
+void PG_framebuffer_draw_arc(struct PG_framebuffer_t *buffer, int cx, int cy, int r, int start_degree, int end_degree, PG_color_t color);
+
+
+// 한 bus에 붙일수 있는 panel 수
+#define PG_BUS_MAX_PANELS 4
+
+// data bus lookup table, setup()에서 한번 만든다
+// byte 값마다 미리 계산해두면 bit 단위로 분기할 필요가 없다
+struct PG_data_table_t {
+    // backend line mask (gpiomem = GPSET0/GPCLR0 mask)
+    uint32_t set_mask[256];
+    uint32_t clr_mask[256];
+    
+    // bit가 1인 data pin 목록
+    uint8_t pin_count[256];
+    uint8_t pin_list[256][8];
+};
+
+// KS0108 bus timing (nsec). 기본값은 datasheet 최소값
+struct PG_timing_t {
+    uint32_t t_as;      // RS/RW/CS -> E rise
+    uint32_t t_pwh;     // E high width
+    uint32_t t_pwl;     // E low width
+    uint32_t t_dsw;     // data setup -> E fall
+    uint32_t t_rst;     // RST low width
+    uint32_t t_ddr;     // E rise -> status data valid
+    uint32_t t_busy;    // 명령 하나 처리 시간, dummy backend가 흉내낸다
+    uint32_t t_busy_timeout;
+    uint32_t t_ah;      // E fall -> RS/RW/CS hold
+    uint32_t t_dhw;     // E fall -> data hold
+};
+
+// emu backend timing check
+typedef enum {
+    PG_EMU_CHECK_AS,    // RS/RW/CS -> E rise
+    PG_EMU_CHECK_PWH,
+    PG_EMU_CHECK_PWL,
+    PG_EMU_CHECK_DSW,   // data -> E fall
+    PG_EMU_CHECK_AH,    // E fall -> RS/RW/CS 변경
+    PG_EMU_CHECK_DHW,   // E fall -> data 변경
+    PG_EMU_CHECK_DDR,   // E rise -> status 읽기
+    PG_EMU_CHECK_BUSY,  // busy인 chip에 쓰기. 실제 chip처럼 무시한다
+    PG_EMU_CHECK_MODEL, // render 후 panel RAM이 driver가 아는 내용(lcd->buffer)과 다름
+    PG_EMU_CHECK_MAX_COUNT,
+} PG_emu_check_t;
+
+// emu backend가 흉내내는 controller 하나
+struct PG_emu_chip_t {
+    uint8_t ram[PG_PAGES][PG_CHIP_COLUMNS];
+    uint8_t page;
+    uint8_t column;
+    uint8_t start_line;
+    bool display_enable;
+    uint64_t busy_until_ns;
+};
+
+// frame pacer
+typedef enum {
+    PG_PACER_SKIP,          // 놓친 deadline은 버리고 다음 주기에 맞춘다
+    PG_PACER_CATCH_UP,      // 늦은 만큼 다음 frame을 쉬지 않고 보낸다
+    PG_PACER_POLICY_MAX_COUNT,
+} PG_pacer_policy_t;
+
+struct PG_pacer_t {
+    // 0 = uncapped
+    uint64_t period_ns;
+    PG_pacer_policy_t policy;
+    // catch up은 최대 이만큼의 주기까지만 따라잡는다
+    uint32_t max_catch_up;
+    
+    uint64_t deadline_ns;
+    bool started;
+    
+    // stats
+    uint64_t frame_count;
+    uint64_t deadline_miss_count;
+    uint64_t skipped_deadline_count;
+    uint64_t max_lateness_ns;
+};
+
+// bus에서 일어난 일 누적 카운터
+struct PG_bus_counters_t {
+    uint64_t bytes;             // display data byte
+    uint64_t commands;
+    uint64_t pulses;            // E pulse
+    uint64_t pin_writes;        // backend까지 간 line 변경
+    uint64_t pin_writes_elided; // shadow가 걸러낸 쓰기
+    uint64_t changed_bytes;     // render에서 panel RAM과 달랐던 framebuffer byte
+};
+
+// bus line 상태. 같은 bus에 붙은 panel은 하나를 같이 쓴다
+struct PG_bus_lines_t {
+    // pin level shadow. 현재 레벨과 같은 쓰기는 backend까지 보내지 않는다
+    // 제어선은 pin_shadow(-1 = unknown), D0..D7은 data가 담당
+    int8_t pin_shadow[PG_PIN_SHADOW_SIZE];
+    uint8_t data;
+    bool data_valid;
+    struct PG_bus_counters_t counters;
+};
+
+// render 단계
+typedef enum {
+    PG_PHASE_DIFF,
+    PG_PHASE_BUS,
+    PG_PHASE_FRAME_END,
+    PG_PHASE_SLEEP,
+    PG_PHASE_MAX_COUNT,
+} PG_phase_t;
+
+// frame time histogram : usec 단위, 2배마다 bucket 4개
+#define PG_METRICS_HISTOGRAM_SIZE 112
+
+// frame time = render_begin부터 pacer sleep 직전까지
+struct PG_metrics_t {
+    uint64_t frame_count;
+    uint32_t frame_time_histogram[PG_METRICS_HISTOGRAM_SIZE];
+    uint64_t frame_time_total_ns;
+    uint64_t frame_time_max_ns;
+    
+    uint64_t phase_total_ns[PG_PHASE_MAX_COUNT];
+    uint64_t last_phase_ns[PG_PHASE_MAX_COUNT];
+    
+    // 마지막 frame 동안의 bus 카운터
+    struct PG_bus_counters_t last_frame;
+    
+    // frame 측정용
+    uint64_t frame_begin_ns;
+    uint64_t phase_mark_ns;
+    struct PG_bus_counters_t frame_begin_counters;
+};
+
+// PG_lcd_get_metrics 결과
+struct PG_metrics_report_t {
+    uint64_t frame_count;
+    uint64_t frame_time_p50_ns;
+    uint64_t frame_time_p99_ns;
+    uint64_t frame_time_max_ns;
+    uint64_t frame_time_avg_ns;
+    
+    // frame당 평균
+    double bytes_per_frame;
+    double commands_per_frame;
+    double pulses_per_frame;
+    double pin_writes_per_frame;
+    // bus로 보낸 data byte / 바뀐 framebuffer byte. commit은 분모에 들어가지 않는다
+    double write_amplification;
+    uint64_t phase_avg_ns[PG_PHASE_MAX_COUNT];
+    
+    struct PG_bus_counters_t last_frame;
+    struct PG_bus_counters_t total;
+};
+
+// refresh planner cost model. 단위는 bus cycle (E pulse 1번 = 1)
+struct PG_bus_cost_t {
+    uint16_t command;
+    uint16_t data;
+    uint16_t chip_select;
+};
+
+// 마지막 render의 planner 결과, naive = 예전 방식으로 보냈을때
+struct PG_refresh_stats_t {
+    uint32_t planned_cycles;
+    uint32_t naive_cycles;
+    uint32_t runs;
+    uint64_t total_planned_cycles;
+    uint64_t total_naive_cycles;
+};
 
 struct PG_lcd_t {
     PG_backend_t backend;
     
     uint8_t rows;
-    uint8_t columns;
+    uint16_t columns;
     uint8_t pages;
     uint8_t chips;
     
     // pin number
     uint8_t pin_rs;
+    uint8_t pin_rw;     // optional, PG_PIN_NONE이면 write only
     uint8_t pin_e;
     uint8_t pin_d0;
     uint8_t pin_d1;
@@ -69,15 +321,60 @@ struct PG_lcd_t {
     uint8_t pin_d7;
     uint8_t pin_cs1;
     uint8_t pin_cs2;
+    uint8_t pin_cs3;    // chip 3개 이상일때만, 아니면 PG_PIN_NONE
+    uint8_t pin_cs4;
     uint8_t pin_rst;
     uint8_t pin_led;
     
     // data
     struct PG_framebuffer_t buffer;
+    // buffer와 같은 내용에서 출발해 dirty를 기록중인 framebuffer
+    // 다른 framebuffer를 render하면 전체를 비교한다
+    const struct PG_framebuffer_t *dirty_source;
+    struct PG_data_table_t data_table;
+    
+    // 혼자 쓸때는 lines_storage, bus에 붙으면 bus의 lines를 가리킨다
+    struct PG_bus_lines_t lines_storage;
+    struct PG_bus_lines_t *lines;
+    struct PG_bus_t *bus;
+    // bus render중 같은 내용을 받는 panel. chip 선택할때 같이 CS를 켠다
+    struct PG_lcd_t *mirror_list[PG_BUS_MAX_PANELS];
+    int mirror_count;
+    // PG_trace_attach가 backend를 감쌌을때
+    struct PG_trace_t *trace;
+    
+    // controller address model, -1 = unknown
+    int8_t chip_page[PG_MAX_CHIPS];
+    int8_t chip_column[PG_MAX_CHIPS];
+    int8_t selected_chip;
+    
+    // display start line. 화면 row r은 RAM row (r + start_line) % rows에 있다
+    // buffer는 RAM 그대로, render할 framebuffer는 화면 기준이다
+    uint8_t start_line;
+    
+    // bus timing, panel마다 다르게 설정할수 있다
+    struct PG_timing_t timing;
+    uint64_t busy_timeout_count;
+    
+    // refresh planner
+    struct PG_bus_cost_t bus_cost;
+    struct PG_refresh_stats_t refresh_stats;
     
     // backend function
     void (*pin_set_val)(struct PG_lcd_t *lcd, uint8_t pin, int val);
+    // optional. RS + D0..D7 at once, NULL = pin_set_val fallback
+    void (*write_bus)(struct PG_lcd_t *lcd, int rs, uint8_t data);
     void (*pulse)(struct PG_lcd_t *lcd);
+    // optional read path, pin_rw와 같이 있어야 busy flag를 쓴다
+    int (*pin_get_val)(struct PG_lcd_t *lcd, uint8_t pin);
+    void (*set_data_direction)(struct PG_lcd_t *lcd, int input);
+    // optional. bus timing delay, NULL = PG_delay_ns
+    void (*delay_ns)(struct PG_lcd_t *lcd, uint32_t nsec);
+    // optional byte level bus interface, NULL = pin level fallback
+    // write_data_run : chip의 page/column부터 length byte를 연속으로 쓴다
+    void (*write_command)(struct PG_lcd_t *lcd, int chip, uint8_t cmd);
+    void (*write_data_run)(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length);
+    void (*chip_broadcast)(struct PG_lcd_t *lcd, uint8_t cmd);
     int (*setup)(struct PG_lcd_t *lcd, PG_pinmap_t pinmap_type);
     int (*frame_end_callback)(struct PG_lcd_t *lcd);
     bool (*is_alive)(struct PG_lcd_t *lcd);
@@ -88,31 +385,348 @@ struct PG_lcd_t {
     uint8_t glfw_val_rs;
     uint8_t glfw_val_e;
     uint8_t glfw_val_data_bits;
-    uint8_t glfw_val_cs1;
-    uint8_t glfw_val_cs2;
+    uint8_t glfw_val_cs[PG_MAX_CHIPS];
     uint8_t glfw_val_rst;
     uint8_t glfw_val_led;
     
     uint8_t glfw_state_display_enable;
-    uint8_t glfw_state_page;
-    uint8_t glfw_state_column;
-    uint8_t glfw_state_chip;
+    uint8_t glfw_state_page[PG_MAX_CHIPS];
+    uint8_t glfw_state_column[PG_MAX_CHIPS];
     uint8_t glfw_state_start_line;
     
     struct PG_framebuffer_t glfw_framebuffer;
+
+    // for gpiomem backend
+    // NULL = /dev/gpiomem on arm, file-backed fake window elsewhere
+    // regular file is always treated as fake register window
+    const char *gpiomem_path;
+    int gpiomem_fd;
+    bool gpiomem_fake;
+    volatile uint32_t *gpiomem_base;
+    int8_t gpiomem_bcm_pin[PG_GPIOMEM_PIN_TABLE_SIZE];
+    uint32_t gpiomem_rs_mask;
+    uint32_t gpiomem_e_mask;
+    
+    // for dummy backend, controller busy 흉내
+    uint8_t dummy_val_rw;
+    uint8_t dummy_val_cs[PG_MAX_CHIPS];
+    uint64_t dummy_busy_until[PG_MAX_CHIPS];
+
+    // for emu backend
+    // window 없이 pin trace를 controller처럼 해석한다
+    // emu 시간은 pin 읽기/쓰기마다 emu_pin_write_ns, delay는 요청한 만큼 흐른다
+    // host에서 기다리지 않으므로 결과가 매번 같다. diff 등 CPU 시간은 포함하지 않는다
+    uint32_t emu_pin_write_ns;
+    struct PG_timing_t emu_timing;  // 검사 기준, 기본값은 datasheet
+    uint8_t emu_val_rs;
+    uint8_t emu_val_rw;
+    uint8_t emu_val_e;
+    uint8_t emu_val_rst;
+    uint8_t emu_val_data_bits;
+    uint8_t emu_val_cs[PG_MAX_CHIPS];
+    uint64_t emu_now_ns;
+    uint64_t emu_address_ns;    // RS/RW/CS 마지막 변경
+    uint64_t emu_data_ns;
+    uint64_t emu_rise_ns;
+    uint64_t emu_fall_ns;
+    struct PG_emu_chip_t emu_chip[PG_MAX_CHIPS];
+    uint64_t emu_violation_count[PG_EMU_CHECK_MAX_COUNT];
+    uint64_t emu_frame_begin_ns;
+    uint64_t emu_frame_ns;      // 마지막 frame을 실제 GPIO로 보냈을때 걸릴 시간
+    uint64_t emu_total_frame_ns;
+    uint64_t emu_frame_count;
     
     // common
-    struct timespec render_begin_tspec;
+    struct PG_pacer_t pacer;
+    struct PG_metrics_t metrics;
+    
+    // async render
+    // slot은 triple buffer. producer는 back, worker는 front를 갖고
+    // middle(slot index | PG_ASYNC_FRESH)을 atomic exchange로 주고받는다
+    struct PG_framebuffer_t async_slot[PG_ASYNC_SLOTS];
+    uint64_t async_slot_seq[PG_ASYNC_SLOTS];
+    uint32_t async_middle;
+    uint32_t async_back;    // producer only
+    uint32_t async_front;   // worker only
+    uint64_t async_submit_seq;
+    uint64_t async_done_seq;
+    uint64_t async_dropped_count;
+    bool async_running;
+    bool async_stop;
+    pthread_t async_thread;
+    // worker 재우기/flush 대기용. bus 전송중에는 잡지 않는다
+    pthread_mutex_t async_mutex;
+    pthread_cond_t async_frame_cond;
+    pthread_cond_t async_done_cond;
 };
 
 void PG_lcd_initialize(struct PG_lcd_t *lcd, PG_backend_t backend_type);
+// chip 수 (1~4). setup 전에 부른다. chip 3, 4는 pin_cs3, pin_cs4가 필요하다
+void PG_lcd_set_geometry(struct PG_lcd_t *lcd, int chips);
+// 기본 배선 (physical pin 번호). main.c와 bench/replay 도구가 같이 쓴다
+// 쓰는 chip 수에 따라 CS를 채우므로 geometry를 정한 뒤 부른다
+void PG_lcd_set_default_pins(struct PG_lcd_t *lcd);
+// "gpio", "glfw", "dummy", "gpiomem", "emu"
+const char *PG_backend_name(PG_backend_t backend);
 void PG_lcd_destroy(struct PG_lcd_t *lcd);
 
+// timing engine
+// busy-wait 루프를 calibrate해서 syscall 없이 짧은 시간을 기다린다
+void PG_timing_calibrate(void);
+void PG_delay_ns(uint32_t nsec);
+uint64_t PG_timing_now_ns(void);
+
+// busy flag. pin_rw와 backend read 지원이 있을때만 동작한다
+bool PG_lcd_can_read_status(struct PG_lcd_t *lcd);
+uint8_t PG_lcd_read_status(struct PG_lcd_t *lcd, int chip);
+bool PG_lcd_wait_ready(struct PG_lcd_t *lcd, int chip);
+
+// backend 밖에서 pin을 건드렸으면 호출해서 shadow를 버린다
+void PG_lcd_shadow_invalidate(struct PG_lcd_t *lcd);
+
+// bus level 접근. render가 쓰는 경로를 benchmark/진단 도구에서 직접 부를때 쓴다
+// pin_set은 shadow를 거친다. write_data_bit은 write_bus op가 없는 backend의 data pin 경로
+void PG_lcd_pin_set(struct PG_lcd_t *lcd, uint8_t pin, int val);
+void PG_lcd_write_data_bit(struct PG_lcd_t *lcd, uint8_t data);
+void PG_lcd_write_bus(struct PG_lcd_t *lcd, int rs, uint8_t data);
+void PG_lcd_pulse(struct PG_lcd_t *lcd);
+// chip은 0 ~ chips - 1 또는 PG_CHIP_ALL. page/column 명령이면 address model도 갱신한다
+void PG_lcd_bus_write_command(struct PG_lcd_t *lcd, int chip, uint8_t cmd);
+void PG_lcd_bus_write_data_run(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length);
+
+// fps <= 0 이면 제한하지 않는다
+void PG_lcd_set_target_fps(struct PG_lcd_t *lcd, double fps);
+void PG_lcd_set_pacer_policy(struct PG_lcd_t *lcd, PG_pacer_policy_t policy);
+
+// render metrics
+void PG_lcd_get_metrics(const struct PG_lcd_t *lcd, struct PG_metrics_report_t *report);
+void PG_lcd_reset_metrics(struct PG_lcd_t *lcd);
+
+// 좌우 chip 내용이 같은 page는 한번에 보낸다
 void PG_lcd_commit_buffer(struct PG_lcd_t *lcd);
+// 화면 전체를 pattern byte로 채운다. 모든 chip에 동시에 쓰므로 commit의 절반 시간
+// pattern은 RAM 기준이라 start line이 8의 배수가 아니면 위아래로 밀려 보인다
+void PG_lcd_fill(struct PG_lcd_t *lcd, uint8_t pattern);
 void PG_lcd_render_buffer(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer);
+// (x, y, w, h) 영역만 비교해서 보낸다. y/h는 page 단위로 넓힌다
+void PG_lcd_render_region(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer, int x, int y, int w, int h);
+// start line을 옮겨서 화면을 rows만큼 위로(음수면 아래로) 민다
+// buffer 내용도 같이 밀고 새로 드러난 row만 dirty로 남긴다
+// 다음 render에서는 새로 그린 row만 보낸다
+void PG_lcd_scroll(struct PG_lcd_t *lcd, struct PG_framebuffer_t *buffer, int rows);
+
+// async render
+// 처음 submit할때 render thread를 띄운다. 전송 전에 새 frame이 오면 이전 frame은 버린다
+// async 중에는 PG_lcd_render_buffer/commit_buffer를 직접 부르지 않는다
+int PG_lcd_submit_async(struct PG_lcd_t *lcd, const struct PG_framebuffer_t *buffer);
+// 마지막으로 submit한 frame이 전송될때까지 기다린다
+void PG_lcd_flush_async(struct PG_lcd_t *lcd);
+// flush 후 render thread 종료. PG_lcd_destroy도 호출한다
+void PG_lcd_stop_async(struct PG_lcd_t *lcd);
+
+// emu backend
+// 화면에 보이는 내용 (start line, display on/off 반영)
+void PG_lcd_emu_snapshot(const struct PG_lcd_t *lcd, struct PG_framebuffer_t *visible);
+const char *PG_emu_check_name(PG_emu_check_t check);
+
+// shared bus
+// D0..D7/RS/E를 같이 쓰고 CS만 다른 panel 묶음
+// panel마다 PG_lcd_t를 만들어 attach한 다음 setup한다
+struct PG_bus_t {
+    struct PG_bus_lines_t lines;
+    struct PG_lcd_t *panel_list[PG_BUS_MAX_PANELS];
+    int panel_count;
+};
+void PG_bus_initialize(struct PG_bus_t *bus);
+int PG_bus_attach(struct PG_bus_t *bus, struct PG_lcd_t *lcd);
+// panel마다 buffer 하나. 내용이 같은 panel은 CS를 같이 켜서 한번에 보낸다
+// pacer와 metrics는 첫번째 panel 것을 쓴다
+void PG_bus_render(struct PG_bus_t *bus, struct PG_framebuffer_t **buffer_list);
+
+// bus trace recorder
+// backend를 감싸서 bus에 나간 것을 고정 크기 ring에 남긴다. 오래된 event부터 덮어쓴다
+// data/E pin 변경은 pulse때 COMMAND/DATA 하나로 기록한다
+// 2의 거듭제곱
+#define PG_TRACE_CAPACITY 16384
+#define PG_TRACE_MAGIC "PGTR"
+#define PG_TRACE_VERSION 1
+
+typedef enum {
+    PG_TRACE_PIN,       // pin = PG_trace_pin_t, value = level
+    PG_TRACE_COMMAND,   // chip_mask = CS가 켜진 chip, value = command
+    PG_TRACE_DATA,      // chip_mask = CS가 켜진 chip, value = display data
+    PG_TRACE_FRAME,     // count = 이번 frame에 바뀐 framebuffer byte
+    PG_TRACE_TYPE_MAX_COUNT,
+} PG_trace_type_t;
+
+// pin 번호 대신 역할로 남겨서 다른 pinmap으로도 replay할수 있다
+typedef enum {
+    PG_TRACE_PIN_RS,
+    PG_TRACE_PIN_RW,
+    PG_TRACE_PIN_RST,
+    PG_TRACE_PIN_LED,
+    PG_TRACE_PIN_CS1,
+    PG_TRACE_PIN_MAX_COUNT = PG_TRACE_PIN_CS1 + PG_MAX_CHIPS,
+} PG_trace_pin_t;
+
+// 16 byte. dump 파일에도 그대로 들어간다 (little endian)
+struct PG_trace_event_t {
+    uint64_t time_ns;   // attach 이후
+    uint8_t type;
+    uint8_t chip_mask;
+    uint8_t pin;
+    uint8_t value;
+    uint32_t count;
+};
+
+struct PG_trace_file_header_t {
+    char magic[4];
+    uint16_t version;
+    uint16_t event_size;
+    uint8_t chips;
+    uint8_t reserved[3];
+    uint32_t event_count;
+};
+
+struct PG_trace_t {
+    // lock-free ring. 기록하는 thread 하나가 event를 쓴 다음 head를 release로 올린다
+    // 읽는 쪽은 복사한 다음 head를 다시 보고 그사이 덮어쓴 event를 버린다
+    struct PG_trace_event_t event_list[PG_TRACE_CAPACITY];
+    uint64_t head;
+    uint64_t begin_ns;
+    uint64_t now_ns;
+    uint8_t chips;
+
+    // pin level 쓰기에서 읽어낸 현재 bus 상태
+    uint8_t val_rs;
+    uint8_t val_rw;
+    uint8_t val_data;
+    uint8_t val_cs_mask;
+    // byte level op 안에서 backend가 부르는 pin/pulse는 따로 기록하지 않는다
+    int depth;
+
+    // write amplification
+    uint64_t data_bytes;
+    uint64_t changed_bytes;
+    uint64_t changed_mark;
+
+    // 감싼 backend
+    struct PG_lcd_t *lcd;
+    void (*inner_pin_set_val)(struct PG_lcd_t *lcd, uint8_t pin, int val);
+    void (*inner_write_bus)(struct PG_lcd_t *lcd, int rs, uint8_t data);
+    void (*inner_pulse)(struct PG_lcd_t *lcd);
+    void (*inner_write_command)(struct PG_lcd_t *lcd, int chip, uint8_t cmd);
+    void (*inner_write_data_run)(struct PG_lcd_t *lcd, int chip, int page, int column, const uint8_t *data, int length);
+    void (*inner_chip_broadcast)(struct PG_lcd_t *lcd, uint8_t cmd);
+    int (*inner_frame_end_callback)(struct PG_lcd_t *lcd);
+};
+// setup 전후 아무때나 붙일수 있다
+void PG_trace_attach(struct PG_trace_t *trace, struct PG_lcd_t *lcd);
+void PG_trace_detach(struct PG_trace_t *trace);
+// 오래된 것부터 최대 capacity개. 다른 thread에서 불러도 된다
+uint32_t PG_trace_snapshot(const struct PG_trace_t *trace, struct PG_trace_event_t *event_list, uint32_t capacity);
+int PG_trace_dump(const struct PG_trace_t *trace, const char *path);
+// 읽은 event는 trace ring에 들어간다. attach하지 않은 trace에 쓴다
+int PG_trace_load(struct PG_trace_t *trace, const char *path);
+// COMMAND/DATA/RST/LED를 lcd의 backend로 다시 보내고 FRAME마다 frame_end_callback을 부른다
+void PG_trace_replay(const struct PG_trace_t *trace, struct PG_lcd_t *lcd);
+// bus data byte / 바뀐 framebuffer byte
+double PG_trace_write_amplification(const struct PG_trace_t *trace);
+
+// text console
+// font5x8 한 글자 = 5 column + 1 column 여백
+#define PG_CONSOLE_CELL_WIDTH 6
+#define PG_CONSOLE_MAX_COLUMNS (PG_MAX_COLUMNS / PG_CONSOLE_CELL_WIDTH)
+#define PG_CONSOLE_ROWS PG_PAGES
+#define PG_CONSOLE_SCROLLBACK 64
+#define PG_CONSOLE_TAB_WIDTH 4
+
+struct PG_console_t {
+    struct PG_lcd_t *lcd;
+    struct PG_framebuffer_t buffer;
+    
+    // scrollback ring. line_head = cursor가 있는 가장 최근 line
+    char line_ring[PG_CONSOLE_SCROLLBACK][PG_CONSOLE_MAX_COLUMNS];
+    int line_head;
+    int line_count;
+    
+    int columns;        // lcd 폭에 들어가는 글자 수
+    int cursor_column;
+    int cursor_row;     // 화면에서 cursor line의 row
+    int view_offset;    // 0 = 최신 line을 따라간다, n = n line 위를 본다
+    
+    // cell마다 다시 그려야 하는지. bit i = column i
+    uint64_t cell_dirty[PG_CONSOLE_ROWS];
+    // 다음 flush때 start line으로 밀어야 하는 line 수
+    int pending_scroll;
+};
+void PG_console_initialize(struct PG_console_t *console, struct PG_lcd_t *lcd);
+// \n, \r, \t 처리, 줄이 차면 다음 줄로 넘긴다. 화면은 flush에서 갱신한다
+void PG_console_write(struct PG_console_t *console, const char *str, size_t length);
+// 바뀐 cell만 그리고 render. 새 line은 hardware scroll로 올린다
+void PG_console_flush(struct PG_console_t *console);
+// 양수면 예전 line 쪽으로 view를 옮긴다
+void PG_console_scroll_view(struct PG_console_t *console, int lines);
+
+// packed font
+// BDF를 fontpack으로 변환한 파일을 mmap해서 쓴다. glyph마다 heap을 쓰지 않는다
+// file = header, glyph index (codepoint 순으로 정렬), bitmap
+// bitmap은 framebuffer처럼 page 단위 : glyph page p의 column i = bitmap[p * width + i], bit r = row p * 8 + r
+// byte order는 little endian (x86/arm 모두 그대로 읽는다)
+#define PG_FONT_MAGIC "PGFN"
+#define PG_FONT_VERSION 1
+// 없는 codepoint나 잘못된 UTF-8 대신 쓴다
+#define PG_FONT_REPLACEMENT 0xFFFD
+
+struct PG_font_file_header_t {
+    char magic[4];
+    uint16_t version;
+    uint16_t glyph_size;        // sizeof(struct PG_font_glyph_t)
+    uint16_t height;            // line 높이 (pixel)
+    uint16_t ascent;            // line 위에서 baseline까지
+    uint32_t glyph_count;
+    uint32_t default_codepoint; // 없는 glyph 대신 그린다
+    uint32_t bitmap_size;
+};
+
+struct PG_font_glyph_t {
+    uint32_t codepoint;
+    uint32_t bitmap_offset;     // bitmap 영역 기준
+    uint8_t width;              // bitmap column 수
+    uint8_t height;             // bitmap row 수
+    uint8_t advance;            // 다음 글자까지 x 이동
+    int8_t x_offset;            // 펜 위치 기준 bitmap 왼쪽
+    int8_t y_offset;            // line 위 기준 bitmap 위쪽
+    uint8_t reserved[3];
+};
+
+struct PG_font_t {
+    const uint8_t *map;
+    size_t map_size;
+    int fd;
+    
+    int height;
+    int ascent;
+    uint32_t glyph_count;
+    const struct PG_font_glyph_t *glyph_list;
+    const uint8_t *bitmap;
+    const struct PG_font_glyph_t *default_glyph;
+};
+// 성공하면 0. header와 index를 검사하고 bitmap은 건드리지 않는다
+int PG_font_open(struct PG_font_t *font, const char *path);
+void PG_font_close(struct PG_font_t *font);
+// 이진 탐색, 없으면 NULL
+const struct PG_font_glyph_t *PG_font_find_glyph(const struct PG_font_t *font, uint32_t codepoint);
+// *str에서 한 글자를 읽고 넘긴다. 잘못된 sequence는 1byte를 먹고 PG_FONT_REPLACEMENT
+uint32_t PG_utf8_decode(const char **str);
+// advance 합
+int PG_font_text_width(const struct PG_font_t *font, const char *str);
+// UTF-8 문자열을 cursor 위치(line 위)에 OR로 그리고 cursor를 advance만큼 옮긴다
+// 세로 위치는 pixel 단위로 자유롭고 화면 밖은 잘린다
+void PG_framebuffer_print_utf8(struct PG_framebuffer_t *buffer, const struct PG_font_t *font, const char *str);
 
 // helper
 #define UNUSED(x) (void)(x)
-#define PG_BUFFER_INDEX(page, column) (page * PG_COLUMNS + column)
+#define PG_BUFFER_INDEX(page, column) ((page) * PG_MAX_COLUMNS + (column))
 
 #endif  // __PG_lcd_H__
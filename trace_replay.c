@@ -0,0 +1,77 @@
+#include "piglcd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// PG_trace_dump로 남긴 trace를 backend에 다시 보낸다
+// ./replay trace.bin [emu|glfw|dummy|gpio|gpiomem]
+
+static struct PG_trace_t trace;
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin [emu|glfw|dummy|gpio|gpiomem]\n", argv[0]);
+        return 1;
+    }
+
+    PG_backend_t backend = PG_BACKEND_EMU;
+    if(argc >= 3) {
+        backend = PG_BACKEND_MAX_COUNT;
+        for(int i = 0 ; i < PG_BACKEND_MAX_COUNT ; ++i) {
+            if(strcmp(argv[2], PG_backend_name(i)) == 0) {
+                backend = i;
+            }
+        }
+        if(backend == PG_BACKEND_MAX_COUNT) {
+            fprintf(stderr, "unknown backend : %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    if(PG_trace_load(&trace, argv[1])) {
+        return 1;
+    }
+
+    struct PG_lcd_t lcd;
+    PG_lcd_initialize(&lcd, backend);
+    PG_lcd_set_geometry(&lcd, trace.chips);
+    PG_lcd_set_default_pins(&lcd);
+
+    if(lcd.setup(&lcd, PG_PINMAP_PHYS)) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+
+    printf("replay %llu events, %d chips, write amplification = %.2f\n",
+           (unsigned long long)trace.head, trace.chips, PG_trace_write_amplification(&trace));
+    PG_trace_replay(&trace, &lcd);
+
+    if(backend == PG_BACKEND_EMU) {
+        for(int i = 0 ; i < PG_EMU_CHECK_MAX_COUNT ; ++i) {
+            if(lcd.emu_violation_count[i] > 0) {
+                printf("%s violations = %llu\n", PG_emu_check_name(i), (unsigned long long)lcd.emu_violation_count[i]);
+            }
+        }
+        if(lcd.emu_frame_count > 0) {
+            printf("emu frame time avg = %.3f ms\n", lcd.emu_total_frame_ns / (double)lcd.emu_frame_count / 1000000.0);
+        }
+
+        struct PG_framebuffer_t visible;
+        PG_lcd_emu_snapshot(&lcd, &visible);
+        for(int y = 0 ; y < PG_ROWS ; ++y) {
+            for(int x = 0 ; x < lcd.columns ; ++x) {
+                int on = (visible.data[PG_BUFFER_INDEX(y / 8, x)] >> (y % 8)) & 1;
+                putchar(on ? '#' : '.');
+            }
+            putchar('\n');
+        }
+    } else if(backend == PG_BACKEND_GLFW) {
+        while(lcd.is_alive(&lcd)) {
+            lcd.frame_end_callback(&lcd);
+        }
+    }
+
+    PG_lcd_destroy(&lcd);
+    return 0;
+}